@@ -25,6 +25,24 @@ ImageViewer::ImageViewer(QWidget* parent)
 	vW->setFillingColor(fillingColor);
 
 	connect(ui->listWidget, &QListWidget::currentRowChanged, this, &ImageViewer::layerSelectionChanged);
+
+	// Shift and Ctrl extend the selection in the list; dragging over empty canvas in move mode selects an area
+	ui->listWidget->setSelectionMode(QAbstractItemView::ExtendedSelection);
+	connect(ui->listWidget, &QListWidget::itemSelectionChanged, this, &ImageViewer::selectedLayersChanged);
+	rubberBand = new QRubberBand(QRubberBand::Rectangle, vW);
+
+	connect(vW, &ViewerWidget::inputLatencyMeasured, this, &ImageViewer::showInputLatency);
+	connect(vW, &ViewerWidget::autosaveFailed, this, &ImageViewer::showAutosaveFailure);
+
+	// The last session's scene comes back from its autosave, edits made up to a crash included
+	if (vW->restoreSession(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/autosave")) {
+		QStringList rows;
+		rows.reserve(vW->getLayerCount());
+		for (int i = 0; i < vW->getLayerCount(); i++) {
+			rows.append(shapeTypeName(vW->getShapeType(i)) + " " + QString::number(vW->getLayerDepth(i) + 1));
+		}
+		ui->listWidget->addItems(rows);
+	}
 }
 
 // Event filters
@@ -72,17 +90,45 @@ void ImageViewer::ViewerWidgetMouseButtonPress(ViewerWidget* w, QEvent* event)
 	static bool polygonActive = false;
 	static bool curveActive = false;
 
+	//	>> Picking: in move mode a click selects the topmost shape under the cursor and its tool,
+	//	unless that shape is already selected, so a group can be dragged by any of its members
+	if (e->button() == Qt::LeftButton && ui->pushButtonMove->isChecked()) {
+		int row = w->layerAt(e->pos());
+		if (row >= 0) {
+			if (!w->isSelected(row)) {
+				ui->listWidget->setCurrentRow(row);
+			}
+			switch (w->getShapeType(row)) {
+			case Shape::LINE: ui->toolButtonDrawLine->setChecked(true); break;
+			case Shape::RECTANGLE: ui->toolButtonDrawRectangle->setChecked(true); break;
+			case Shape::POLYGON: ui->toolButtonDrawPolygon->setChecked(true); break;
+			case Shape::CIRCLE: ui->toolButtonDrawCircle->setChecked(true); break;
+			case Shape::BEZIER_CURVE: ui->toolButtonDrawCurve->setChecked(true); break;
+			}
+			w->setMoveStart(e->pos());
+			w->beginManipulation();
+		}
+		else {
+			selectingArea = true;
+			selectionOrigin = e->pos();
+			rubberBand->setGeometry(QRect(selectionOrigin, QSize()));
+			rubberBand->show();
+			w->setMoveStart(QPoint());
+		}
+	}
+
 	//	>> Line Drawing
 	if (e->button() == Qt::LeftButton && ui->toolButtonDrawLine->isChecked() && !ui->pushButtonMove->isChecked())
 	{
 		if (w->getDrawLineActivated()) {
-			int layerIndex = ui->listWidget->count();
+			int layerIndex = w->getNextLayerDepth();
 			ui->listWidget->addItem(QString("Line %1").arg(layerIndex + 1));
 			int newRowIndex = ui->listWidget->count() - 1;
 			ui->listWidget->setCurrentRow(newRowIndex);
 			layerSelectionChanged(newRowIndex);
 
-			line = new Line(w->getDrawLineBegin(), e->pos(), layerIndex, ui->checkBoxFilling->isChecked(), borderColor, fillingColor);
+			line = w->getShapePool().create<Line>(w->getDrawLineBegin(), e->pos(), layerIndex, ui->checkBoxFilling->isChecked(), borderColor, fillingColor);
+			applyLayerBlending(line);
 			w->drawLine(*line);
 			w->addToZBuffer(*line, line->getZBufferPosition());
 
@@ -101,12 +147,13 @@ void ImageViewer::ViewerWidgetMouseButtonPress(ViewerWidget* w, QEvent* event)
 	if (e->button() == Qt::LeftButton && ui->toolButtonDrawCircle->isChecked() && !ui->pushButtonMove->isChecked())
 	{
 		if (w->getDrawCircleActivated()) {
-			int layerIndex = ui->listWidget->count();
+			int layerIndex = w->getNextLayerDepth();
 			ui->listWidget->addItem(QString("Circle %1").arg(layerIndex + 1));
 			int newRowIndex = ui->listWidget->count() - 1;
 			ui->listWidget->setCurrentRow(newRowIndex);
 
-			circle = new Circle(w->getDrawCircleCenter(), e->pos(), layerIndex, ui->checkBoxFilling->isChecked(), borderColor, fillingColor);
+			circle = w->getShapePool().create<Circle>(w->getDrawCircleCenter(), e->pos(), layerIndex, ui->checkBoxFilling->isChecked(), borderColor, fillingColor);
+			applyLayerBlending(circle);
 			w->drawCircle(*circle);
 			vW->addToZBuffer(*circle, circle->getZBufferPosition());
 			w->setDrawCircleActivated(false);
@@ -119,15 +166,25 @@ void ImageViewer::ViewerWidgetMouseButtonPress(ViewerWidget* w, QEvent* event)
 		}
 	}
 
+	// Clearing or loading a scene releases an unfinished polygon or curve along with the rest
+	if (polygonActive && !w->getShapePool().get(polygonHandle)) {
+		polygonActive = false;
+	}
+	if (curveActive && !w->getShapePool().get(curveHandle)) {
+		curveActive = false;
+	}
+
 	//	>> Polygon Drawing
 	if (e->button() == Qt::LeftButton && ui->toolButtonDrawPolygon->isChecked() && !ui->pushButtonMove->isChecked()) {
 		if (!polygonActive) {
-			int layerIndex = ui->listWidget->count();
+			int layerIndex = w->getNextLayerDepth();
 			ui->listWidget->addItem(QString("Polygon %1").arg(layerIndex + 1));
 			int newRowIndex = ui->listWidget->count() - 1;
 			ui->listWidget->setCurrentRow(newRowIndex);
 
-			polygon = new MyPolygon(QVector<QPoint>(), layerIndex, ui->checkBoxFilling->isChecked(), borderColor, fillingColor);
+			polygon = w->getShapePool().create<MyPolygon>(QVector<QPoint>(), layerIndex, ui->checkBoxFilling->isChecked(), borderColor, fillingColor);
+			polygonHandle = w->getShapePool().handleOf(polygon);
+			applyLayerBlending(polygon);
 			polygonActive = true;
 		}
 
@@ -145,12 +202,14 @@ void ImageViewer::ViewerWidgetMouseButtonPress(ViewerWidget* w, QEvent* event)
 	//	>> Curve Drawing
 	if (e->button() == Qt::LeftButton && ui->toolButtonDrawCurve->isChecked() && !ui->pushButtonMove->isChecked()) {
 		if (!curveActive) {
-			int layerIndex = ui->listWidget->count();
-			ui->listWidget->addItem(QString("Bezier Curve %1").arg(ui->listWidget->count() + 1));
+			int layerIndex = w->getNextLayerDepth();
+			ui->listWidget->addItem(QString("Bezier Curve %1").arg(layerIndex + 1));
 			int newRowIndex = ui->listWidget->count() - 1;
 			ui->listWidget->setCurrentRow(newRowIndex);
 
-			curve = new BezierCurve(QVector<QPoint>(), ui->listWidget->count(), ui->checkBoxFilling->isChecked(), borderColor, fillingColor);
+			curve = w->getShapePool().create<BezierCurve>(QVector<QPoint>(), layerIndex, ui->checkBoxFilling->isChecked(), borderColor, fillingColor);
+			curveHandle = w->getShapePool().handleOf(curve);
+			applyLayerBlending(curve);
 			curveActive = true;
 		}
 
@@ -170,18 +229,19 @@ void ImageViewer::ViewerWidgetMouseButtonPress(ViewerWidget* w, QEvent* event)
 	if (e->button() == Qt::LeftButton && ui->toolButtonDrawRectangle->isChecked() && !ui->pushButtonMove->isChecked())
 	{
 		if (w->getDrawRectangleActivated()) {
-			int layerIndex = ui->listWidget->count();
+			int layerIndex = w->getNextLayerDepth();
 			ui->listWidget->addItem(QString("Rectangle %1").arg(layerIndex + 1));
 			int newRowIndex = ui->listWidget->count() - 1;
 			ui->listWidget->setCurrentRow(newRowIndex);
 			
 			if ((e->pos().y() > w->getDrawRectangleBegin().y() && e->pos().x() > w->getDrawRectangleBegin().x()) || (e->pos().y() < w->getDrawRectangleBegin().y() && w->getDrawRectangleBegin().x() > e->pos().x())) {
-				rectangle = new MyRectangle(w->getDrawRectangleBegin(), QPoint(e->pos().x(), w->getDrawRectangleBegin().y()), e->pos(), QPoint(w->getDrawRectangleBegin().x(), e->pos().y()), layerIndex, ui->checkBoxFilling->isChecked(), borderColor, fillingColor);
+				rectangle = w->getShapePool().create<MyRectangle>(w->getDrawRectangleBegin(), QPoint(e->pos().x(), w->getDrawRectangleBegin().y()), e->pos(), QPoint(w->getDrawRectangleBegin().x(), e->pos().y()), layerIndex, ui->checkBoxFilling->isChecked(), borderColor, fillingColor);
 			}
 			else {
-				rectangle = new MyRectangle(w->getDrawRectangleBegin(), QPoint(w->getDrawRectangleBegin().x(), e->pos().y()), e->pos(), QPoint(e->pos().x(), w->getDrawRectangleBegin().y()), layerIndex, ui->checkBoxFilling->isChecked(), borderColor, fillingColor);
+				rectangle = w->getShapePool().create<MyRectangle>(w->getDrawRectangleBegin(), QPoint(w->getDrawRectangleBegin().x(), e->pos().y()), e->pos(), QPoint(e->pos().x(), w->getDrawRectangleBegin().y()), layerIndex, ui->checkBoxFilling->isChecked(), borderColor, fillingColor);
 			}
 
+			applyLayerBlending(rectangle);
 			w->drawRectangle(*rectangle);
 			vW->addToZBuffer(*rectangle, rectangle->getZBufferPosition());
 			w->setDrawRectangleActivated(false);
@@ -197,79 +257,39 @@ void ImageViewer::ViewerWidgetMouseButtonPress(ViewerWidget* w, QEvent* event)
 void ImageViewer::ViewerWidgetMouseButtonRelease(ViewerWidget* w, QEvent* event)
 {
 	QMouseEvent* e = static_cast<QMouseEvent*>(event);
+
+	//	>> Area selection
+	if (e->button() == Qt::LeftButton && selectingArea) {
+		selectingArea = false;
+		rubberBand->hide();
+		selectRows(w->selectInRect(QRect(selectionOrigin, e->pos()).normalized()));
+	}
+
+	//	>> End of a drag: the exact redraw replaces the one from cached composites
+	if (e->button() == Qt::LeftButton) {
+		w->endManipulation();
+	}
 }
 void ImageViewer::ViewerWidgetMouseMove(ViewerWidget* w, QEvent* event)
 {
 	QMouseEvent* e = static_cast<QMouseEvent*>(event);
 
-	//	>> Polygon Movement
-	if (ui->toolButtonDrawPolygon->isChecked()) {
-		if (e->buttons() & Qt::LeftButton && ui->pushButtonMove->isChecked()) {
-			QPoint offset = e->pos() -  w->getMoveStart();
-			if (!w->getMoveStart().isNull()) {
-				w->movePolygon(offset);
-			}
-			w->setMoveStart(e->pos());
-		}
-		else if (ui->pushButtonMove->isChecked()) {
-			w->setMoveStart(QPoint());
-		}
-	}
-	
-	//	>> Line Movement
-	if (ui->toolButtonDrawLine->isChecked()) {
-		if (e->buttons() & Qt::LeftButton && ui->pushButtonMove->isChecked()) {
-			QPoint offset = e->pos() - w->getMoveStart();
-			if (!w->getMoveStart().isNull()) {
-				w->moveLine(offset);
-			}
-			w->setMoveStart(e->pos());
-		}
-		else if (ui->pushButtonMove->isChecked()) {
-			w->setMoveStart(QPoint());
-		}
-	}
-	
-	//	>> Curve Movement
-	if (ui->toolButtonDrawCurve->isChecked()) {
-		if (e->buttons() & Qt::LeftButton && ui->pushButtonMove->isChecked()) {
-			QPoint offset = e->pos() - w->getMoveStart();
-			if (!w->getMoveStart().isNull()) {
-				w->moveCurve(offset);
-			}
-			w->setMoveStart(e->pos());
-		}
-		else if (ui->pushButtonMove->isChecked()) {
-			w->setMoveStart(QPoint());
-		}
+	//	>> Area selection
+	if (selectingArea) {
+		rubberBand->setGeometry(QRect(selectionOrigin, e->pos()).normalized());
+		return;
 	}
 
-	//	>> Circle Movement
-	if (ui->toolButtonDrawCircle->isChecked()) {
-		if (e->buttons() & Qt::LeftButton && ui->pushButtonMove->isChecked()) {
-			QPoint offset = e->pos() - w->getMoveStart();
-			if (!w->getMoveStart().isNull()) {
-				w->moveCircle(offset);
-			}
-			w->setMoveStart(e->pos());
-		}
-		else if (ui->pushButtonMove->isChecked()) {
-			w->setMoveStart(QPoint());
+	//	>> Selection Movement
+	if (e->buttons() & Qt::LeftButton && ui->pushButtonMove->isChecked()) {
+		QPoint offset = e->pos() - w->getMoveStart();
+		if (!w->getMoveStart().isNull()) {
+			w->queueMoveSelection(offset);
 		}
+		w->setMoveStart(e->pos());
 	}
-
-	//	>> Rectangle Movement
-	if (ui->toolButtonDrawRectangle->isChecked()) {
-		if (e->buttons() & Qt::LeftButton && ui->pushButtonMove->isChecked()) {
-			QPoint offset = e->pos() - w->getMoveStart();
-			if (!w->getMoveStart().isNull()) {
-				w->moveRectangle(offset);
-			}
-			w->setMoveStart(e->pos());
-		}
-		else if (ui->pushButtonMove->isChecked()) {
-			w->setMoveStart(QPoint());
-		}
+	else if (ui->pushButtonMove->isChecked()) {
+		w->setMoveStart(QPoint());
 	}
 }
 void ImageViewer::ViewerWidgetLeave(ViewerWidget* w, QEvent* event)
@@ -291,21 +311,7 @@ void ImageViewer::ViewerWidgetWheel(ViewerWidget* w, QEvent* event)
 		else if (deltaY > 0) {
 			scale = 1.25;
 		}
-		if (ui->toolButtonDrawPolygon->isChecked()) {
-			w->scalePolygon(scale, scale);
-		}
-		if (ui->toolButtonDrawLine->isChecked()) {
-			w->scaleLine(scale, scale);
-		}
-		if (ui->toolButtonDrawCurve->isChecked()) {
-			w->scaleCurve(scale, scale);
-		}
-		if (ui->toolButtonDrawCircle->isChecked()) {
-			w->scaleCircle(scale, scale);
-		}
-		if (ui->toolButtonDrawRectangle->isChecked()) {
-			w->scaleRectangle(scale, scale);
-		}
+		w->queueScaleSelection(scale);
 	}
 }
 
@@ -335,10 +341,18 @@ bool ImageViewer::saveImage(QString filename)
 	QFileInfo fi(filename);
 	QString extension = fi.completeSuffix();
 
+	vW->finishRendering();
 	QImage* img = vW->getImage();
 	return img->save(filename, extension.toStdString().c_str());
 }
 
+//Layer functions
+void ImageViewer::applyLayerBlending(Shape* shape)
+{
+	shape->setOpacity(ui->doubleSpinBoxOpacity->value());
+	shape->setBlendMode(static_cast<Shape::BlendMode>(ui->comboBoxBlendMode->currentIndex()));
+}
+
 //-----------------------------------------
 //		*** Tools 2D slots ***
 //-----------------------------------------
@@ -348,6 +362,36 @@ void ImageViewer::layerSelectionChanged(int currentRow) {
 	vW->setLayer(currentLayer);
 }
 
+void ImageViewer::selectedLayersChanged() {
+	QVector<int> rows;
+	for (QListWidgetItem* item : ui->listWidget->selectedItems()) {
+		rows.append(ui->listWidget->row(item));
+	}
+	vW->setSelection(rows);
+}
+
+void ImageViewer::showInputLatency() {
+	ViewerWidget::InputLatency latency = vW->getInputLatency();
+	ui->statusBar->showMessage(QString("Input latency %1 ms (average %2 ms, worst %3 ms over %4 frames)")
+		.arg(latency.lastMs, 0, 'f', 1).arg(latency.averageMs, 0, 'f', 1).arg(latency.worstMs, 0, 'f', 1).arg(latency.frames));
+}
+
+void ImageViewer::showAutosaveFailure() {
+	ui->statusBar->showMessage("Autosave stopped: unable to write the autosave journal.");
+	QMessageBox::warning(this, "Autosave Error", "Unable to write the autosave journal. Edits from now on are not autosaved; save the scene to keep them.");
+}
+
+void ImageViewer::selectRows(const QVector<int>& rows) {
+	// One selection update for the whole batch instead of one per row
+	ui->listWidget->blockSignals(true);
+	ui->listWidget->clearSelection();
+	for (int row : rows) {
+		ui->listWidget->item(row)->setSelected(true);
+	}
+	ui->listWidget->blockSignals(false);
+	selectedLayersChanged();
+}
+
 void ImageViewer::on_actionSave_as_triggered()
 {
 	QString folder = settings.value("folder_img_save_path", "").toString();
@@ -419,40 +463,16 @@ void ImageViewer::on_pushButtonSetBorderColor_clicked()
 
 void ImageViewer::on_pushButtonChangeLayerColor_clicked() {
 	vW->changeLayerColor(ui->listWidget->currentRow(), borderColor, fillingColor);
-	vW->redrawAllShapes();
+	vW->changeLayerBlending(ui->listWidget->currentRow(), static_cast<Shape::BlendMode>(ui->comboBoxBlendMode->currentIndex()), ui->doubleSpinBoxOpacity->value());
+	vW->redrawDirtyRegion();
 }
 
 void ImageViewer::on_pushButtonTurn_clicked() {
-	if (ui->toolButtonDrawPolygon->isChecked()) {
-		vW->turnPolygon(ui->spinBoxTurn->value());
-	}
-	if (ui->toolButtonDrawLine->isChecked()) {
-		vW->turnLine(ui->spinBoxTurn->value());
-	}
-	if (ui->toolButtonDrawCurve->isChecked()) {
-		vW->turnCurve(ui->spinBoxTurn->value());
-	}
-	if (ui->toolButtonDrawRectangle->isChecked()) {
-		vW->turnRectangle(ui->spinBoxTurn->value());
-	}
+	vW->turnSelection(ui->spinBoxTurn->value());
 }
 
 void ImageViewer::on_pushButtonScale_clicked() {
-	if (ui->toolButtonDrawPolygon->isChecked()) {
-		vW->scalePolygon(ui->doubleSpinBoxScaleX->value(), ui->doubleSpinBoxScaleY->value());
-	}
-	if (ui->toolButtonDrawLine->isChecked()) {
-		vW->scaleLine(ui->doubleSpinBoxScaleX->value(), ui->doubleSpinBoxScaleY->value());
-	}
-	if (ui->toolButtonDrawCurve->isChecked()) {
-		vW->scaleCurve(ui->doubleSpinBoxScaleX->value(), ui->doubleSpinBoxScaleY->value());
-	}
-	if (ui->toolButtonDrawCircle->isChecked()) {
-		vW->scaleCircle(ui->doubleSpinBoxScaleX->value(), ui->doubleSpinBoxScaleY->value());
-	}
-	if (ui->toolButtonDrawRectangle->isChecked()) {
-		vW->scaleRectangle(ui->doubleSpinBoxScaleX->value(), ui->doubleSpinBoxScaleY->value());
-	}
+	vW->scaleSelection(ui->doubleSpinBoxScaleX->value(), ui->doubleSpinBoxScaleY->value());
 }
 
 void ImageViewer::on_pushButtonLayerUp_clicked() {
@@ -495,8 +515,6 @@ void ImageViewer::on_pushButtonLayerDown_clicked() {
 		ui->listWidget->insertItem(newRowIndex, currentItem);
 
 		ui->listWidget->setCurrentRow(newRowIndex);
-
-		vW->redrawAllShapes();
 	}
 	else {
 		QMessageBox::warning(this, "Invalid Depth", "You have reached the minimum depth for Z-Buffer.");
@@ -515,8 +533,6 @@ void ImageViewer::on_pushButtonDeleteObject_clicked() {
 
 	QListWidgetItem* item = ui->listWidget->takeItem(currentRow);
 	delete item;
-
-	vW->redrawAllShapes();
 }
 
 void ImageViewer::on_pushButtonSaveImage_clicked() {
@@ -524,13 +540,13 @@ void ImageViewer::on_pushButtonSaveImage_clicked() {
 }
 
 void ImageViewer::on_pushButtonLoadImage_clicked() {
-	QString filePath = QFileDialog::getOpenFileName(this, "Load Image State", "C:\\Pocitacova_grafika_projects\\ImageViewer_projekt_zaverecny", "CSV Files (*.csv)");
+	QString filePath = QFileDialog::getOpenFileName(this, "Load Image State", "C:\\Pocitacova_grafika_projects\\ImageViewer_projekt_zaverecny", "Scenes (*.csv *.ivs);;CSV Files (*.csv);;Binary Scenes (*.ivs)");
 	if (filePath.isEmpty()) {
 		return;
 	}
 
-	QFile file(filePath);
-	if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+	// Checked before the current scene is released, so a file that cannot be read leaves it in place
+	if (!QFileInfo(filePath).isReadable()) {
 		QMessageBox::warning(this, "File Error", "Unable to open file for reading.");
 		return;
 	}
@@ -538,67 +554,41 @@ void ImageViewer::on_pushButtonLoadImage_clicked() {
 	vW->clearZBuffer();
 	ui->listWidget->clear();
 
-	QTextStream in(&file);
-
-	in.readLine();
-
-	while (!in.atEnd()) {
-		QString line = in.readLine();
-		QStringList fields = line.split(',');
-
-		if (fields.size() < 6) {
-			QMessageBox::warning(this, "File Error", "Invalid file format.");
-			return;
-		}
-
-		QString shapeType = fields[0];
-		int zBufferPosition = fields[1].toInt();
-		bool isFilled = (fields[2] == "true");
-		QColor borderColor(fields[3]);
-		QColor fillingColor(fields[4]);
-
-		QVector<QPoint> points;
-		QString pointsStr = fields.mid(5).join(",");
-		QStringList pointPairs = pointsStr.split(' ', Qt::SkipEmptyParts);
-		for (const QString& pair : pointPairs) {
-			QString cleanPair = pair.trimmed().remove('(').remove(')');
-			QStringList coords = cleanPair.split(',');
-			if (coords.size() == 2) {
-				int x = coords[0].toInt();
-				int y = coords[1].toInt();
-				points.append(QPoint(x, y));
-			}
-		}
-
-		Shape* shape = nullptr;
-		if (shapeType == "Line" && points.size() == 2) {
-			shape = new Line(points[0], points[1], zBufferPosition, isFilled, borderColor, fillingColor);
-		}
-		else if (shapeType == "Rectangle" && points.size() == 4) {
-			shape = new MyRectangle(points[0], points[1], points[2], points[3], zBufferPosition, isFilled, borderColor, fillingColor);
-		}
-		else if (shapeType == "Polygon" && points.size() >= 3) {
-			shape = new MyPolygon(points, zBufferPosition, isFilled, borderColor, fillingColor);
-		}
-		else if (shapeType == "Circle" && points.size() == 2) {
-			shape = new Circle(points[0], points[1], zBufferPosition, isFilled, borderColor, fillingColor);
-		}
-		else if (shapeType == "BezierCurve" && points.size() >= 3) {
-			shape = new BezierCurve(points, zBufferPosition, isFilled, borderColor, fillingColor);
-		}
-		else {
-			QMessageBox::warning(this, "File Error", "Invalid shape type or points in file.");
-			continue;
-		}
-
-		if (shape != nullptr) {
-			vW->addToZBuffer(*shape, zBufferPosition);
-			ui->listWidget->addItem(shapeType + " " + QString::number(zBufferPosition + 1));
-		}
+	SceneFile scene;
+	if (!loadScene(filePath, scene, vW->getShapePool())) {
+		vW->redrawAllShapes();
+		QMessageBox::warning(this, "File Error", "Unable to open file for reading.");
+		return;
 	}
 
-	file.close();
+	// The list mirrors the layer order, which sorts the file's shapes by depth
+	vW->addToZBuffer(scene.shapes);
+	std::stable_sort(scene.shapes.begin(), scene.shapes.end(), [](const std::pair<Shape*, int>& a, const std::pair<Shape*, int>& b) {
+		return a.second < b.second;
+		});
+	QStringList rows;
+	rows.reserve(static_cast<int>(scene.shapes.size()));
+	for (const auto& entry : scene.shapes) {
+		rows.append(shapeTypeName(entry.first->getType()) + " " + QString::number(entry.second + 1));
+	}
+	ui->listWidget->addItems(rows);
 	vW->redrawAllShapes();
 
+	// Every problem of the file in one summary
+	QStringList problems;
+	if (scene.formatError) {
+		problems.append(scene.formatErrorLine > 0 ? QString("Invalid file format at line %1; the rest of the file was not read.").arg(scene.formatErrorLine)
+			: QString("Invalid file format."));
+	}
+	if (scene.invalidShapes > 0) {
+		problems.append(scene.firstInvalidLine > 0 ? QString("%1 shapes with an invalid type or points were skipped, the first at line %2.").arg(scene.invalidShapes).arg(scene.firstInvalidLine)
+			: QString("%1 shapes with an invalid type or points were skipped.").arg(scene.invalidShapes));
+	}
+	if (!problems.isEmpty()) {
+		problems.prepend(QString("%1 shapes were loaded.").arg(scene.shapes.size()));
+		QMessageBox::warning(this, "File Error", problems.join("\n"));
+		return;
+	}
+
 	QMessageBox::information(this, "Load Successful", "The saved state has been loaded successfully.");
 }
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include "ViewerWidget.h"
 #include "lighting.h"
 #include "representation.h"
+#include "sceneio.h"
 
 class ImageViewer : public QMainWindow
 {
@@ -31,6 +32,13 @@ private:
 	BezierCurve* curve = nullptr;
 	Line* line = nullptr;
 	Circle* circle = nullptr;
+	// Polygons and curves stay unfinished across clicks; the handles notice when the scene drops them
+	ShapeHandle polygonHandle;
+	ShapeHandle curveHandle;
+	// Area selection in move mode
+	QRubberBand* rubberBand = nullptr;
+	QPoint selectionOrigin;
+	bool selectingArea = false;
 
 	//Event filters
 	bool eventFilter(QObject* obj, QEvent* event);
@@ -51,11 +59,19 @@ private:
 	bool openImage(QString filename);
 	bool saveImage(QString filename);
 
+	//Layer functions
+	// Selects exactly rows in the layer list
+	void selectRows(const QVector<int>& rows);
+	void applyLayerBlending(Shape* shape);
+
 private slots:
 	void on_actionSave_as_triggered();
 	void on_actionClear_triggered();
 	void on_actionExit_triggered();
 	void layerSelectionChanged(int currentRow);
+	void selectedLayersChanged();
+	void showInputLatency();
+	void showAutosaveFailure();
 	void on_pushButtonSaveImage_clicked();
 	void on_pushButtonLoadImage_clicked();
 
@@ -1,12 +1,19 @@
 #include   "ViewerWidget.h"
+#include "instrumentation.h"
 
 ViewerWidget::ViewerWidget(QSize imgSize, QWidget* parent)
 	: QWidget(parent)
 {
 	setAttribute(Qt::WA_StaticContents);
 	setMouseTracking(true);
+	tileRenderer.setLayerCache(&layerCache);
+	frameTimer.setSingleShot(true);
+	frameTimer.setTimerType(Qt::PreciseTimer);
+	connect(&frameTimer, &QTimer::timeout, this, &ViewerWidget::flushPendingInput);
+	journalTimer.setInterval(journalFlushMs);
+	connect(&journalTimer, &QTimer::timeout, this, &ViewerWidget::flushJournal);
 	if (imgSize != QSize(0, 0)) {
-		img = new QImage(imgSize, QImage::Format_ARGB32);
+		img = new QImage(imgSize, QImage::Format_ARGB32_Premultiplied);
 		img->fill(Qt::white);
 		resizeWidget(img->size());
 		setPainter();
@@ -15,6 +22,9 @@ ViewerWidget::ViewerWidget(QSize imgSize, QWidget* parent)
 }
 ViewerWidget::~ViewerWidget()
 {
+	cancelRendering();
+	sceneRenderer.wait();
+	journal.close();
 	delete painter;
 	delete img;
 }
@@ -31,11 +41,12 @@ void ViewerWidget::resizeWidget(QSize size)
 
 bool ViewerWidget::setImage(const QImage& inputImg)
 {
+	cancelRendering();
 	if (img != nullptr) {
 		delete painter;
 		delete img;
 	}
-	img = new QImage(inputImg);
+	img = new QImage(inputImg.convertToFormat(QImage::Format_ARGB32_Premultiplied));
 	if (!img) {
 		return false;
 	}
@@ -63,12 +74,13 @@ bool ViewerWidget::changeSize(int width, int height)
 	QSize newSize(width, height);
 
 	if (newSize != QSize(0, 0)) {
+		cancelRendering();
 		if (img != nullptr) {
 			delete painter;
 			delete img;
 		}
 
-		img = new QImage(newSize, QImage::Format_ARGB32);
+		img = new QImage(newSize, QImage::Format_ARGB32_Premultiplied);
 		if (!img) {
 			return false;
 		}
@@ -84,6 +96,7 @@ bool ViewerWidget::changeSize(int width, int height)
 
 void ViewerWidget::clear()
 {
+	cancelRendering();
 	img->fill(Qt::white);
 	update();
 }
@@ -93,6 +106,12 @@ void ViewerWidget::paintEvent(QPaintEvent* event)
 	QPainter painter(this);
 	QRect area = event->rect();
 	painter.drawImage(area, *img, area);
+
+	// The first paint after a coalesced frame is the one that shows it
+	if (awaitingPresent) {
+		awaitingPresent = false;
+		recordInputLatency(presentClock.nsecsElapsed() / 1e6);
+	}
 }
 
 //-----------------------------------------
@@ -106,11 +125,8 @@ void ViewerWidget::setPixel(int x, int y, uchar r, uchar g, uchar b, uchar a)
 	b = b > 255 ? 255 : (b < 0 ? 0 : b);
 	a = a > 255 ? 255 : (a < 0 ? 0 : a);
 
-	size_t startbyte = y * img->bytesPerLine() + x * 4;
-	data[startbyte] = b;
-	data[startbyte + 1] = g;
-	data[startbyte + 2] = r;
-	data[startbyte + 3] = a;
+	size_t startbyte = y * bytesPerLine + x * 4;
+	*reinterpret_cast<QRgb*>(data + startbyte) = qPremultiply(qRgba(r, g, b, a));
 }
 void ViewerWidget::setPixel(int x, int y, double valR, double valG, double valB, double valA)
 {
@@ -119,11 +135,9 @@ void ViewerWidget::setPixel(int x, int y, double valR, double valG, double valB,
 	valB = valB > 1 ? 1 : (valB < 0 ? 0 : valB);
 	valA = valA > 1 ? 1 : (valA < 0 ? 0 : valA);
 
-	size_t startbyte = y * img->bytesPerLine() + x * 4;
-	data[startbyte] = static_cast<uchar>(255 * valB);
-	data[startbyte + 1] = static_cast<uchar>(255 * valG);
-	data[startbyte + 2] = static_cast<uchar>(255 * valR);
-	data[startbyte + 3] = static_cast<uchar>(255 * valA);
+	size_t startbyte = y * bytesPerLine + x * 4;
+	QRgb color = qRgba(static_cast<uchar>(255 * valR), static_cast<uchar>(255 * valG), static_cast<uchar>(255 * valB), static_cast<uchar>(255 * valA));
+	*reinterpret_cast<QRgb*>(data + startbyte) = qPremultiply(color);
 }
 void ViewerWidget::setPixel(int x, int y, const QColor& color)
 {
@@ -131,48 +145,33 @@ void ViewerWidget::setPixel(int x, int y, const QColor& color)
 		return;
 	}
 
-	size_t startbyte = y * img->bytesPerLine() + x * 4;
-
-	data[startbyte] = color.blue();
-	data[startbyte + 1] = color.green();
-	data[startbyte + 2] = color.red();
-	data[startbyte + 3] = color.alpha();
+	size_t startbyte = y * bytesPerLine + x * 4;
+	blendPixel(reinterpret_cast<QRgb*>(data + startbyte), premultiplyColor(color), Shape::SOURCE_OVER);
 }
 
 //-----------------------------------------
 //		*** Drawing functions ***
 //-----------------------------------------
 void ViewerWidget::changeLayerColor(int zBufferPosition, const QColor& newBorderColor, const QColor& newFillingColor) {
-	for (auto& pair : zBuffer) {
-		if (pair.second == zBufferPosition) {
-			Shape& shape = pair.first.get();
-
-			shape.setBorderColor(newBorderColor);
-			shape.setFillingColor(newFillingColor);
-
-			switch (shape.getType()) {
-			case Shape::LINE:
-				drawLine(static_cast<Line&>(shape));
-				break;
-			case Shape::RECTANGLE:
-				drawRectangle(static_cast<MyRectangle&>(shape));
-				break;
-			case Shape::POLYGON:
-				drawPolygon(static_cast<MyPolygon&>(shape));
-				break;
-			case Shape::CIRCLE:
-				drawCircle(static_cast<Circle&>(shape));
-				break;
-			case Shape::BEZIER_CURVE:
-				drawCurve(static_cast<BezierCurve&>(shape));
-				break;
-			default:
-				break;
-			}
-
-			update();
-			break;
-		}
+	if (zBufferPosition >= 0 && zBufferPosition < layers.size()) {
+		Shape& shape = *layers.at(zBufferPosition);
+
+		shape.setBorderColor(newBorderColor);
+		shape.setFillingColor(newFillingColor);
+		requestLayerMasks(shape.getBoundingRect());
+		markDirty(shape.getBoundingRect());
+		journal.recordRecolor(zBufferPosition, newBorderColor, newFillingColor);
+	}
+}
+
+void ViewerWidget::changeLayerBlending(int zBufferPosition, Shape::BlendMode newBlendMode, double newOpacity) {
+	if (zBufferPosition >= 0 && zBufferPosition < layers.size()) {
+		Shape& shape = *layers.at(zBufferPosition);
+		shape.setBlendMode(newBlendMode);
+		shape.setOpacity(newOpacity);
+		requestLayerMasks(shape.getBoundingRect());
+		markDirty(shape.getBoundingRect());
+		journal.recordReblend(zBufferPosition, newBlendMode, newOpacity);
 	}
 }
 
@@ -209,58 +208,215 @@ void ViewerWidget::drawShape(Shape& shape) {
 }
 
 void ViewerWidget::addToZBuffer(Shape& shape, int depth) {
-	zBuffer.push_back(std::make_pair(std::ref(shape), depth));
-	std::sort(zBuffer.begin(), zBuffer.end(), [](const std::pair<std::reference_wrapper<Shape>, int>& a, const std::pair<std::reference_wrapper<Shape>, int>& b) {
-		return a.second < b.second;
-		});
+	layers.insert(&shape, depth);
+	spatialIndex.insert(&shape);
+	journal.recordAdd(shape, depth);
+}
+
+void ViewerWidget::addToZBuffer(const std::vector<std::pair<Shape*, int>>& shapes) {
+	layers.insertBulk(shapes);
+	for (const auto& entry : shapes) {
+		spatialIndex.insert(entry.first);
+	}
+
+	// A load is journaled as a snapshot of the scene rather than a record per shape
+	if (journal.isOpen()) {
+		std::vector<std::pair<Shape*, int>> scene;
+		scene.reserve(layers.size());
+		layers.forEach([&scene](Shape* layer, int depth) { scene.push_back(std::make_pair(layer, depth)); });
+		journal.recordScene(scene);
+	}
 }
 
 void ViewerWidget::deleteObjectFromZBuffer(int currentIndex) {
-	if (currentIndex >= 0 && currentIndex < zBuffer.size()) {
-		zBuffer.erase(zBuffer.begin() + currentIndex);
+	if (currentIndex >= 0 && currentIndex < layers.size()) {
+		flushPendingInput();
+		endManipulation();
+		Shape& shape = *layers.at(currentIndex);
+		markDirty(shape.getBoundingRect());
+		layerCache.invalidate(&shape);
+		spatialIndex.remove(&shape);
+		// The id is reused by the next new layer
+		selectedIds.erase(std::remove(selectedIds.begin(), selectedIds.end(), layers.idAt(currentIndex)), selectedIds.end());
+		layers.removeAt(currentIndex);
+		shapePool.release(&shape);
+		journal.recordRemove(currentIndex);
+		redrawDirtyRegion();
 	}
 }
 
 void ViewerWidget::moveShapeUp(int zBufferPosition) {
-	auto it = std::find_if(zBuffer.begin(), zBuffer.end(), [zBufferPosition](const auto& pair) {
-		return pair.second == zBufferPosition;
-		});
-
-	if (it != zBuffer.end() && it != zBuffer.begin()) {
-		auto prevIt = std::prev(it);
-		std::iter_swap(it, prevIt);
-		std::swap(it->second, prevIt->second);
-		redrawAllShapes();
+	if (zBufferPosition > 0 && zBufferPosition < layers.size()) {
+		flushPendingInput();
+		endManipulation();
+		// Only pixels covered by both shapes can change when their order flips
+		QRect overlap = layers.at(zBufferPosition)->getBoundingRect().intersected(layers.at(zBufferPosition - 1)->getBoundingRect());
+		requestLayerMasks(overlap);
+		markDirty(overlap);
+		layers.swapAdjacent(zBufferPosition - 1);
+		journal.recordSwap(zBufferPosition - 1);
+		redrawDirtyRegion();
 	}
 }
 
 void ViewerWidget::moveShapeDown(int zBufferPosition) {
-	auto it = std::find_if(zBuffer.begin(), zBuffer.end(), [zBufferPosition](const auto& pair) {
-		return pair.second == zBufferPosition;
-		});
+	if (zBufferPosition >= 0 && zBufferPosition + 1 < layers.size()) {
+		flushPendingInput();
+		endManipulation();
+		QRect overlap = layers.at(zBufferPosition)->getBoundingRect().intersected(layers.at(zBufferPosition + 1)->getBoundingRect());
+		requestLayerMasks(overlap);
+		markDirty(overlap);
+		layers.swapAdjacent(zBufferPosition);
+		journal.recordSwap(zBufferPosition);
+		redrawDirtyRegion();
+	}
+}
+
+void ViewerWidget::requestLayerMasks(const QRect& area) {
+	// Recolors and reorders redraw the same layers again and again, so the layers one redraws get cache
+	// masks from then on. Redraws heavy enough for the render thread draw copies, which never use them.
+	if (area.isEmpty() || !layerCache.isEnabled()) {
+		return;
+	}
+	std::vector<Shape*> reached;
+	spatialIndex.query(area.adjusted(-1, -1, 1, 1), reached);
+	if (static_cast<int>(reached.size()) > asyncShapeThreshold) {
+		return;
+	}
+	for (Shape* shape : reached) {
+		layerCache.request(shape);
+	}
+}
 
-	if (it != zBuffer.end() && (it + 1) != zBuffer.end()) {
-		auto nextIt = std::next(it);
-		std::iter_swap(it, nextIt);
-		std::swap(it->second, nextIt->second);
-		redrawAllShapes();
+void ViewerWidget::collectShapes(const QRect& area, std::vector<Shape*>& shapes) {
+	// View culling: only shapes whose bounds reach into area, ranked back into painter's order
+	spatialIndex.query(area, shapes);
+	rankedShapes.clear();
+	rankedShapes.reserve(shapes.size());
+	for (Shape* shape : shapes) {
+		rankedShapes.push_back({ layers.positionOf(shape), shape });
+	}
+	std::sort(rankedShapes.begin(), rankedShapes.end());
+	for (size_t i = 0; i < rankedShapes.size(); i++) {
+		shapes[i] = rankedShapes[i].second;
 	}
 }
 
 void ViewerWidget::redrawAllShapes() {
-	clear();
-	for (auto& shapePair : zBuffer) {
-		drawShape(shapePair.first.get());
+	INSTRUMENT_SCOPE("ViewerWidget::redrawAllShapes");
+	// Everything is redrawn, so earlier marks need no pass of their own
+	dirtyRegion = QRegion(img->rect());
+	redrawDirtyRegion();
+}
+
+int ViewerWidget::layerAt(const QPoint& point, int tolerance) {
+	std::vector<Shape*> hits;
+	spatialIndex.hitsAt(point, tolerance, hits);
+
+	int topmost = -1;
+	for (Shape* shape : hits) {
+		topmost = std::max(topmost, layers.positionOf(shape));
 	}
-	update();
+	return topmost;
+}
+
+void ViewerWidget::markDirty(const QRect& rect) {
+	// One pixel of slack matches the binning in TileRenderer
+	QRect area = rect.adjusted(-1, -1, 1, 1).intersected(img->rect());
+	if (!area.isEmpty()) {
+		dirtyRegion += area;
+	}
+}
+
+void ViewerWidget::transformShape(Shape& shape, const QTransform& transform) {
+	markDirty(shape.getBoundingRect());
+	layerCache.invalidate(&shape);
+	shape.applyTransform(transform);
+	spatialIndex.update(&shape);
+	markDirty(shape.getBoundingRect());
+}
+
+void ViewerWidget::redrawDirtyRegion() {
+	if (dirtyRegion.isEmpty()) {
+		return;
+	}
+
+	INSTRUMENT_SCOPE("ViewerWidget::redrawDirtyRegion");
+	INSTRUMENT_COUNT(Redraws, 1);
+
+	// Edits made while a frame renders are drawn after it is shown, so they land on top of it
+	if (sceneRenderer.isBusy()) {
+		pendingRender += dirtyRegion;
+		dirtyRegion = QRegion();
+		// A frame that would be drawn over entirely is stale: stop it rather than wait for it
+		if (sceneRenderer.busyRegion().subtracted(pendingRender).isEmpty()) {
+			sceneRenderer.cancel();
+		}
+		return;
+	}
+
+	// Heavy redraws go to the render thread and leave the GUI responsive meanwhile
+	if (!manipulating && layers.size() > asyncShapeThreshold) {
+		std::vector<Shape*> reached;
+		spatialIndex.query(dirtyRegion.boundingRect(), reached);
+		if (static_cast<int>(reached.size()) > asyncShapeThreshold) {
+			startRender(dirtyRegion);
+			dirtyRegion = QRegion();
+			return;
+		}
+	}
+
+	// The renderer clears each rectangle and redraws only the shapes whose bounds reach into it.
+	// A region split into many pieces, as a group edit leaves, is redrawn as one rectangle instead:
+	// a single parallel pass beats many small ones that each pay for binning and dispatch.
+	std::vector<Shape*> shapes;
+	if (manipulating) {
+		// Only the manipulated layers are rasterized; the rest comes from the two composites
+		for (const QRect& rect : dirtyRegion) {
+			tileRenderer.renderBetween(*img, manipulatedShapes, rect, belowLayers, aboveLayers);
+		}
+		manipulatedRegion += dirtyRegion;
+	}
+	else if (dirtyRegion.rectCount() > maxDirtyRects) {
+		collectShapes(dirtyRegion.boundingRect(), shapes);
+		tileRenderer.render(*img, shapes, dirtyRegion.boundingRect(), qRgb(255, 255, 255));
+	}
+	else {
+		for (const QRect& rect : dirtyRegion) {
+			collectShapes(rect, shapes);
+			tileRenderer.render(*img, shapes, rect, qRgb(255, 255, 255));
+		}
+	}
+
+	update(dirtyRegion);
+	dirtyRegion = QRegion();
 }
 
 void ViewerWidget::saveCurrentImageState() {
-	QString filePath = QFileDialog::getSaveFileName(this, "Save Image State", "C:\\Pocitacova_grafika_projects\\ImageViewer_projekt_zaverecny", "CSV Files (*.csv)");
+	const QString csvFilter = "CSV Files (*.csv)";
+	const QString binaryFilter = "Binary Scenes (*.ivs)";
+	const QString compressedFilter = "Compressed Binary Scenes (*.ivs)";
+	QString selectedFilter;
+	QString filePath = QFileDialog::getSaveFileName(this, "Save Image State", "C:\\Pocitacova_grafika_projects\\ImageViewer_projekt_zaverecny",
+		csvFilter + ";;" + binaryFilter + ";;" + compressedFilter, &selectedFilter);
 	if (filePath.isEmpty()) {
 		return;
 	}
 
+	// Binary scenes keep alpha, opacity and blend modes, and load without parsing
+	bool binary = filePath.endsWith(".ivs", Qt::CaseInsensitive) || (selectedFilter != csvFilter && !filePath.endsWith(".csv", Qt::CaseInsensitive));
+	if (binary) {
+		std::vector<std::pair<Shape*, int>> shapes;
+		shapes.reserve(layers.size());
+		layers.forEach([&shapes](Shape* layer, int zBufferPosition) { shapes.push_back(std::make_pair(layer, zBufferPosition)); });
+		if (!saveSceneBinary(filePath, shapes, selectedFilter == compressedFilter)) {
+			QMessageBox::warning(this, "File Error", "Unable to open file for writing.");
+			return;
+		}
+		QMessageBox::information(this, "Save Successful", "The current state has been saved successfully.");
+		return;
+	}
+
 	QFile file(filePath);
 	if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
 		QMessageBox::warning(this, "File Error", "Unable to open file for writing.");
@@ -271,706 +427,401 @@ void ViewerWidget::saveCurrentImageState() {
 
 	out << "ShapeType,ZBufferPosition,IsFilled,BorderColor,FillingColor,Points\n";
 
-	for (const auto& pair : zBuffer) {
-		Shape& shape = pair.first.get();
-		int zBufferPosition = pair.second;
-		QString shapeType;
-		switch (shape.getType()) {
-		case Shape::LINE:
-			shapeType = "Line";
-			break;
-		case Shape::RECTANGLE:
-			shapeType = "Rectangle";
-			break;
-		case Shape::POLYGON:
-			shapeType = "Polygon";
-			break;
-		case Shape::CIRCLE:
-			shapeType = "Circle";
-			break;
-		case Shape::BEZIER_CURVE:
-			shapeType = "BezierCurve";
-			break;
-		}
+	layers.forEach([&out](Shape* layer, int zBufferPosition) {
+		Shape& shape = *layer;
+		QString shapeType = shapeTypeName(shape.getType());
 
 		QString borderColor = shape.getBorderColor().name();
 		QString fillingColor = shape.getFillingColor().name();
 		QString isFilled = shape.getIsFilled() ? "true" : "false";
 
 		QString points;
-		QVector<QPoint> shapePoints = shape.getPoints();
-		for (const QPoint& point : shapePoints) {
+		for (const QPoint& point : shape.pointSpan()) {
 			points += QString("(%1,%2) ").arg(point.x()).arg(point.y());
 		}
 		points = points.trimmed();
 
 		out << shapeType << "," << zBufferPosition << "," << isFilled << "," << borderColor << "," << fillingColor << "," << points << "\n";
-	}
+	});
 
 	file.close();
 
 	QMessageBox::information(this, "Save Successful", "The current state has been saved successfully.");
 }
 
-//-----------------------------------------
-//		*** Line functions ***
-//-----------------------------------------
-void ViewerWidget::drawLine(Line& line)
-{
-	borderColor = line.getBorderColor();
-	painter->setPen(QPen(borderColor));
-
-	QVector<QPoint> linePoints = line.getPoints();
-
-	QVector<QPoint> lineToClip = line.getPoints();
-
-	clipLineWithPolygon(lineToClip);
-
-	// Overenie, ci bola usecka orezana a aktualizacia linePoints podla potreby
-	if (lineToClip.size() == 2) { // Kontrola, ci orezanie zmenilo body
-		linePoints.append(lineToClip[0]);
-		linePoints.append(lineToClip[1]);
-	}
-	else {
-		// Ak orezanie uplne odstranilo usecku alebo nezmenilo body, vykreslenie povodnej usecky
-		linePoints.append(line.getPoints()[0]);
-		linePoints.append(line.getPoints()[1]);
-	}
-
-	for (const QPoint& point : linePoints) {
-		qDebug() << point;
+void ViewerWidget::flushJournal() {
+	journal.flush();
+	// Reported once, from the first tick after opening, flushing or beginning a generation failed
+	if (journal.hasFailed()) {
+		journalTimer.stop();
+		emit autosaveFailed();
 	}
-
-	drawLineBresenham(linePoints);
-	line.setPoints(linePoints);
-	update();
 }
 
-void ViewerWidget::clipLineWithPolygon(QVector<QPoint> linePoints) {
-	if (linePoints.size() < 2) {
-		return; // Nedostatok bodov na vytvorenie èiary
-	}
-
-	QVector<QPoint> clippedPoints;
-	QPoint P1 = linePoints[0], P2 = linePoints[1];
-	double t_min = 0, t_max = 1; // Inicializácia t-hodnôt
-	QPoint d = P2 - P1; // Smerový vektor úseèky
-	//qDebug() << "Povodny useckovy segment od" << P1 << "do" << P2;
-
-	// Definícia hrán orezovacieho obdåžnika
-	QVector<QPoint> E = { QPoint(0,0), QPoint(500,0), QPoint(500,500), QPoint(0,500) };
-
-	for (int i = 0; i < E.size(); i++) {
-		QPoint E1 = E[i];
-		QPoint E2 = E[(i + 1) % E.size()]; // Zopnutie pre poslednú hranu
-
-		QPoint normal = QPoint(E2.y() - E1.y(), E1.x() - E2.x()); // Opravené znamienko
+bool ViewerWidget::restoreSession(const QString& directory) {
+	journal.close();
+	clearZBuffer();
+	bool restored = SceneJournal::recover(directory, layers, shapePool);
+	std::vector<std::pair<Shape*, int>> scene;
+	scene.reserve(layers.size());
+	layers.forEach([this, &scene](Shape* layer, int depth) {
+		spatialIndex.insert(layer);
+		scene.push_back(std::make_pair(layer, depth));
+		});
 
-		QPoint w = P1 - E1; // Vektor z koncového bodu hrany k P1
+	// The new generation starts from the scene as recovered, so records never land on a different one
+	journal.open(directory, scene);
+	journalTimer.start();
+	redrawAllShapes();
+	return restored;
+}
 
-		double dn = d.x() * normal.x() + d.y() * normal.y();
-		double wn = w.x() * normal.x() + w.y() * normal.y();
-		if (dn != 0) {
-			double t = -wn / dn;
-			//qDebug() << "Hodnota t priesecnika s hranou" << i << ":" << t;
-			if (dn > 0 && t <= 1) {
-				t_min = std::max(t, t_min); // Aktualizácia t_min, ak dn > 0 a t <= 1
-			}
-			else if (dn < 0 && t >= 0) {
-				t_max = std::min(t, t_max); // Aktualizácia t_max, ak dn < 0 a t >= 0
-			}
+//-----------------------------------------
+//		*** Selection functions ***
+//-----------------------------------------
+void ViewerWidget::setSelection(const QVector<int>& zBufferPositions) {
+	// Queued input belongs to the selection it was aimed at
+	flushPendingInput();
+	endManipulation();
+	selectedIds.clear();
+	for (int position : zBufferPositions) {
+		if (position >= 0 && position < layers.size()) {
+			selectedIds.push_back(layers.idAt(position));
 		}
 	}
+}
 
-	//qDebug() << "t_min:" << t_min << "t_max:" << t_max;
-
-	if (t_min < t_max) {
-		QPoint clippedP1 = P1 + (P2 - P1) * t_min; // Výpoèet orezaného zaèiatoèného bodu
-		QPoint clippedP2 = P1 + (P2 - P1) * t_max; // Výpoèet orezaného koncového bodu
-		//qDebug() << "Orezany useckovy segment od" << clippedP1 << "do" << clippedP2;
-
-		clippedPoints.push_back(clippedP1);
-		clippedPoints.push_back(clippedP2);
-	}
-	else {
-		//qDebug() << "Useckovy segment je uplne mimo orezovacej oblasti alebo je neplatny.";
-	}
-
-	// Aktualizácia pôvodných linePoints s orezanými bodmi
-	if (!clippedPoints.isEmpty()) {
-		linePoints = clippedPoints;
+bool ViewerWidget::isSelected(int zBufferPosition) const {
+	if (zBufferPosition < 0 || zBufferPosition >= layers.size()) {
+		return false;
 	}
+	return std::find(selectedIds.begin(), selectedIds.end(), layers.idAt(zBufferPosition)) != selectedIds.end();
 }
 
-void ViewerWidget::drawLineBresenham(QVector<QPoint>& linePoints) {
-	int p, k1, k2;
-	int dx = linePoints.last().x() - linePoints.first().x();  // Rozdiel x súradníc
-	int dy = linePoints.last().y() - linePoints.first().y();  // Rozdiel y súradníc
-
-	int adx = abs(dx); // Absolútna hodnota dx
-	int ady = abs(dy); // Absolútna hodnota dy
-
-	int x = linePoints.first().x(); // Zaèiatoèná x pozícia
-	int y = linePoints.first().y(); // Zaèiatoèná y pozícia
-
-	int incrementX = (dx > 0) ? 1 : -1; // Urèenie smeru posunu po x-ovej osi
-	int incrementY = (dy > 0) ? 1 : -1; // Urèenie smeru posunu po y-ovej osi
-
-	if (adx > ady) {
-		// Èiara je strmšia v x-ovej osi
-		p = 2 * ady - adx;  // Inicializácia rozhodovacieho parametra
-		k1 = 2 * ady;       // Konštanta pre horizontálny krok
-		k2 = 2 * (ady - adx);  // Konštanta pre diagonálny krok
-
-		while (x != linePoints.last().x()) {
-			setPixel(x, y, borderColor); // Kreslenie bodu na aktuálnych súradniciach
-			x += incrementX; // Posun v x-ovej osi
-			if (p >= 0) {
-				y += incrementY; // Posun v y-ovej osi, ak je to potrebné
-				p += k2; // Aktualizácia rozhodovacieho parametra
-			}
-			else {
-				p += k1; // Aktualizácia rozhodovacieho parametra
-			}
+QVector<int> ViewerWidget::selectInRect(const QRect& rect) {
+	// Candidates come from the index; only shapes lying wholly inside rect are taken
+	std::vector<Shape*> candidates;
+	spatialIndex.query(rect, candidates);
+	QVector<int> positions;
+	for (Shape* shape : candidates) {
+		if (rect.contains(shape->getBoundingRect())) {
+			positions.append(layers.positionOf(shape));
 		}
 	}
-	else {
-		// Èiara je strmšia v y-ovej osi
-		p = 2 * adx - ady;  // Inicializácia rozhodovacieho parametra
-		k1 = 2 * adx;       // Konštanta pre vertikálny krok
-		k2 = 2 * (adx - ady);  // Konštanta pre diagonálny krok
-
-		while (y != linePoints.last().y()) {
-			setPixel(x, y, borderColor); // Kreslenie bodu na aktuálnych súradniciach
-			y += incrementY; // Posun v y-ovej osi
-			if (p >= 0) {
-				x += incrementX; // Posun v x-ovej osi, ak je to potrebné
-				p += k2; // Aktualizácia rozhodovacieho parametra
-			}
-			else {
-				p += k1; // Aktualizácia rozhodovacieho parametra
-			}
-		}
-	}
-
-	setPixel(linePoints.last().x(), linePoints.last().y(), borderColor); // Vykreslenie posledného bodu
+	std::sort(positions.begin(), positions.end());
+	setSelection(positions);
+	return positions;
 }
 
-void ViewerWidget::moveLine(const QPoint& offset) {
-	if (currentLayer >= 0 && currentLayer < zBuffer.size()) {
-		auto& pair = zBuffer[currentLayer];
-		qDebug() << "ShapeType: " << pair.first.get().getType();
-		if (pair.first.get().getType() == Shape::LINE) {
-			Line& line = static_cast<Line&>(pair.first.get());
-			QVector<QPoint> points = line.getPoints();
-
-			for (QPoint& point : points) {
-				point += offset;
-			}
+// Conjugates transform with a translation, so it acts around pivot instead of the origin
+static QTransform aroundPivot(const QTransform& transform, const QPointF& pivot) {
+	return QTransform::fromTranslate(-pivot.x(), -pivot.y()) * transform * QTransform::fromTranslate(pivot.x(), pivot.y());
+}
 
-			pair.first.get().setPoints(points);
-			redrawAllShapes();
-		}
+QPointF ViewerWidget::selectionCenter() const {
+	// A lone shape turns about its own center, a group about the middle of its joint bounds
+	if (selectedIds.size() == 1) {
+		return layers.shapeOf(selectedIds.front())->getCenter();
 	}
+	QRect bounds;
+	for (int id : selectedIds) {
+		bounds |= layers.shapeOf(id)->getBoundingRect();
+	}
+	return QRectF(bounds).center();
 }
 
-void ViewerWidget::turnLine(int angle) {
-	if (currentLayer >= 0 && currentLayer < zBuffer.size()) {
-		auto& pair = zBuffer[currentLayer];
-		if (pair.first.get().getType() == Shape::LINE) {
-			Line& line = static_cast<Line&>(pair.first.get());
-			QVector<QPoint> points = line.getPoints();
-			QPoint center = getLineCenter(line);
-
-			double radians = qDegreesToRadians(static_cast<double>(angle));
-			double cosAngle = std::cos(radians);
-			double sinAngle = std::sin(radians);
-
-			QVector<QPoint> rotatedPoints;
-
-			for (QPoint& point : points) {
-				int translatedX = point.x() - center.x();
-				int translatedY = point.y() - center.y();
-
-				int rotatedX = static_cast<int>(translatedX * cosAngle - translatedY * sinAngle);
-				int rotatedY = static_cast<int>(translatedX * sinAngle + translatedY * cosAngle);
-
-				rotatedX += center.x();
-				rotatedY += center.y();
+void ViewerWidget::transformSelection(const QTransform& transform) {
+	if (selectedIds.empty()) {
+		return;
+	}
 
-				rotatedPoints.push_back(QPoint(rotatedX, rotatedY));
-			}
+	INSTRUMENT_SCOPE("ViewerWidget::transformSelection");
+	for (int id : selectedIds) {
+		transformShape(*layers.shapeOf(id), transform);
+	}
 
-			pair.first.get().setPoints(rotatedPoints);
-			redrawAllShapes();
+	if (journal.isOpen()) {
+		std::vector<int> positions;
+		positions.reserve(selectedIds.size());
+		for (int id : selectedIds) {
+			positions.push_back(layers.positionOf(id));
 		}
+		journal.recordTransform(positions, transform);
 	}
 }
 
-QPoint ViewerWidget::getLineCenter(Line& line) const {
-	QVector<QPoint> points = line.getPoints();
-	if (points.isEmpty()) {
-		return QPoint();
+void ViewerWidget::turnSelection(int angle) {
+	if (!selectedIds.empty()) {
+		flushPendingInput();
+		transformSelection(aroundPivot(QTransform().rotate(angle), selectionCenter()));
+		redrawDirtyRegion();
 	}
-
-	double centroidX = (points.first().x() + points.last().x()) / 2;
-	double centroidY = (points.first().y() + points.last().y()) / 2;
-
-	return QPoint(static_cast<int>(centroidX), static_cast<int>(centroidY));
 }
 
-void ViewerWidget::scaleLine(double scaleX, double scaleY) {
-	if (currentLayer >= 0 && currentLayer < zBuffer.size()) {
-		auto& pair = zBuffer[currentLayer];
-		if (pair.first.get().getType() == Shape::LINE) {
-			Line& line = static_cast<Line&>(pair.first.get());
-			QVector<QPoint> points = line.getPoints();
-			QPoint center = getLineCenter(line);
-
-			QVector<QPoint> scaledPoints;
-
-			for (QPoint& point : points) {
-				double newX = center.x() + (point.x() - center.x()) * scaleX;
-				double newY = center.y() + (point.y() - center.y()) * scaleY;
-
-				scaledPoints.append(QPoint(static_cast<int>(std::round(newX)), static_cast<int>(std::round(newY))));
-			}
-
-			pair.first.get().setPoints(scaledPoints);
-			redrawAllShapes();
-		}
+void ViewerWidget::scaleSelection(double scaleX, double scaleY) {
+	if (!selectedIds.empty()) {
+		flushPendingInput();
+		transformSelection(aroundPivot(QTransform::fromScale(scaleX, scaleY), selectionCenter()));
+		redrawDirtyRegion();
 	}
 }
 
 //-----------------------------------------
-//		*** Circle functions ***
+//		*** Input coalescing ***
 //-----------------------------------------
-void ViewerWidget::drawCircle(Circle& circle) {
-	borderColor = circle.getBorderColor();
-	fillingColor = circle.getFillingColor();
-	QPoint center = circle.getPoints()[0];
-	QPoint radiusPoint = circle.getPoints()[1];
-	int r = std::sqrt(std::pow(radiusPoint.x() - center.x(), 2) + std::pow(radiusPoint.y() - center.y(), 2));
-	int x = 0;
-	int y = r;
-	int p = 1 - r;
-
-	if (circle.getIsFilled()) {
-		drawSymmetricPointsFilled(center, x, y);
-	}
-	else {
-		drawSymmetricPoints(center, x, y);
-	}
-
-	while (x < y) {
-		x++;
-		if (p < 0) {
-			p += 2 * x + 1;
-		}
-		else {
-			y--;
-			p += 2 * (x - y) + 1;
-		}
-
-		if (circle.getIsFilled()) {
-			drawSymmetricPointsFilled(center, x, y);
-		}
-		else {
-			drawSymmetricPoints(center, x, y);
-		}
-	}
-
-	update();
+void ViewerWidget::queueMoveSelection(const QPoint& offset) {
+	pendingOffset += offset;
+	scheduleFrame();
 }
 
-void ViewerWidget::drawSymmetricPoints(const QPoint& center, int x, int y) {
-	QPoint points[8] = {
-		QPoint(x, y),
-		QPoint(y, x),
-		QPoint(-x, y),
-		QPoint(-y, x),
-		QPoint(-x, -y),
-		QPoint(-y, -x),
-		QPoint(x, -y),
-		QPoint(y, -x)
-	};
-
-	for (auto& point : points) {
-		setPixel(center.x() + point.x(), center.y() + point.y(), borderColor);
-	}
+void ViewerWidget::queueScaleSelection(double factor) {
+	pendingScale *= factor;
+	scheduleFrame();
 }
 
-void ViewerWidget::drawSymmetricPointsFilled(const QPoint& center, int x, int y) {
-	for (int i = -x; i <= x; i++) {
-		setPixel(center.x() + i, center.y() + y, fillingColor);
-		setPixel(center.x() + i, center.y() - y, fillingColor);
+void ViewerWidget::scheduleFrame() {
+	if (!hasPendingInput) {
+		hasPendingInput = true;
+		inputClock.start();
 	}
-	for (int i = -y; i <= y; i++) {
-		setPixel(center.x() + i, center.y() + x, fillingColor);
-		setPixel(center.x() + i, center.y() - x, fillingColor);
+	if (!frameTimer.isActive()) {
+		// Right away after an idle spell, otherwise one frame interval after the previous frame
+		qint64 sinceFrame = frameClock.isValid() ? frameClock.elapsed() : frameIntervalMs;
+		frameTimer.start(static_cast<int>(std::max<qint64>(0, frameIntervalMs - sinceFrame)));
 	}
 }
 
-void ViewerWidget::moveCircle(const QPoint& offset) {
-	if (currentLayer >= 0 && currentLayer < zBuffer.size()) {
-		auto& pair = zBuffer[currentLayer];
-		if (pair.first.get().getType() == Shape::CIRCLE) {
-			Circle& circle = static_cast<Circle&>(pair.first.get());
-			QVector<QPoint> points = circle.getPoints();
+void ViewerWidget::flushPendingInput() {
+	if (!hasPendingInput) {
+		return;
+	}
 
-			for (QPoint& point : points) {
-				point += offset;
-			}
+	INSTRUMENT_SCOPE("ViewerWidget::flushPendingInput");
+	hasPendingInput = false;
+	frameTimer.stop();
+	frameClock.start();
 
-			pair.first.get().setPoints(points);
-			redrawAllShapes();
+	// Wheel steps land before the drag offsets that arrived with them; within one frame the order is not visible
+	if (!selectedIds.empty()) {
+		if (manipulationPending && (pendingScale != 1.0 || !pendingOffset.isNull())) {
+			buildManipulation();
+		}
+		if (pendingScale != 1.0) {
+			transformSelection(aroundPivot(QTransform::fromScale(pendingScale, pendingScale), selectionCenter()));
+		}
+		if (!pendingOffset.isNull()) {
+			transformSelection(QTransform::fromTranslate(pendingOffset.x(), pendingOffset.y()));
 		}
 	}
-}
+	pendingOffset = QPoint();
+	pendingScale = 1.0;
 
-void ViewerWidget::scaleCircle(double scaleX, double scaleY) {
-	if (currentLayer >= 0 && currentLayer < zBuffer.size()) {
-		auto& pair = zBuffer[currentLayer];
-		if (pair.first.get().getType() == Shape::CIRCLE) {
-			Circle& circle = static_cast<Circle&>(pair.first.get());
-			QVector<QPoint> points = circle.getPoints();
-			QPoint center = points[0];
-			QPoint radiusPoint = points[1];
-
-			int newX = center.x() + static_cast<int>((radiusPoint.x() - center.x()) * scaleX);
-			int newY = center.y() + static_cast<int>((radiusPoint.y() - center.y()) * scaleY);
-			points[1] = QPoint(newX, newY);
-
-			pair.first.get().setPoints(points);
-			redrawAllShapes();
-		}
+	if (!dirtyRegion.isEmpty()) {
+		presentClock = inputClock;
+		awaitingPresent = true;
+		redrawDirtyRegion();
 	}
 }
 
-
 //-----------------------------------------
-//		*** Polygon Functions ***
+//		*** Background rendering ***
 //-----------------------------------------
-void ViewerWidget::drawPolygon(MyPolygon& polygon) {
-	borderColor = polygon.getBorderColor();
-	fillingColor = polygon.getFillingColor();
-	const QVector<QPoint>& pointsVector = polygon.getPoints();
-
-	if (pointsVector.size() < 2) {
-		QMessageBox::warning(this, "Nizky pocet bodov", "Nebol dosiahnuty minimalny pocet bodov pre vykreslenie polygonu.");
-		return;
+void ViewerWidget::startRender(const QRegion& region) {
+	INSTRUMENT_SCOPE("ViewerWidget::startRender");
+	auto snapshot = std::make_shared<RenderSnapshot>();
+	snapshot->canvasSize = img->size();
+	if (region.rectCount() > maxDirtyRects) {
+		snapshot->rects.append(region.boundingRect());
 	}
-
-	painter->setPen(QPen(borderColor));
-	QVector<QPoint> polygonPoints = pointsVector;
-
-	// Kontrola, či sú všetky body mimo definovaného plátna/kresliacej oblasti
-	bool allPointsOutside = std::all_of(pointsVector.begin(), pointsVector.end(), [this](const QPoint& point) {
-		return !isInside(point);
-		});
-
-	if (allPointsOutside) {
-		qDebug() << "Polygon je mimo hranicu.";
-		return;
-	}
-
-	// Kontrola každého bodu, či sa nachádza v kresliacej oblasti, a prípadné orezanie polygonu
-	for (QPoint point : pointsVector) {
-		if (!isInside(point)) {
-			polygonPoints = trimPolygon(polygon); // Orezanie polygónu, ak nejaké body prekračujú hranice
-			break;
+	else {
+		for (const QRect& rect : region) {
+			snapshot->rects.append(rect);
 		}
 	}
 
-	if (polygon.getIsFilled()) {
-		fillPolygon(polygon);
+	// The frame draws copies, so the scene is free to change while it renders
+	std::vector<Shape*> shapes;
+	if (region.boundingRect() == img->rect()) {
+		layers.collect(shapes);
 	}
-	painter->setPen(QPen(borderColor));
-
-	std::vector<Line> lines;
-	if (!polygonPoints.isEmpty()) {
-		for (int i = 0; i < polygonPoints.size() - 1; i++) {
-			lines.emplace_back(polygonPoints.at(i), polygonPoints.at(i + 1), polygon.getZBufferPosition(), polygon.getIsFilled(), borderColor, fillingColor);
-		}
-		lines.emplace_back(polygonPoints.last(), polygonPoints.first(), polygon.getZBufferPosition(), polygon.getIsFilled(), borderColor, fillingColor);
+	else {
+		collectShapes(region.boundingRect(), shapes);
 	}
-
-	for (Line& line : lines) {
-		drawLine(line);
+	snapshot->shapes.reserve(shapes.size());
+	for (Shape* shape : shapes) {
+		snapshot->shapes.push_back(snapshot->pool.clone(*shape));
 	}
 
-	update();
+	sceneRenderer.start(snapshot, this, [this]() { finishRender(); });
 }
 
-QPoint ViewerWidget::getPolygonCenter(Shape& polygon) const {
-	const QVector<QPoint>& points = polygon.getPoints();
-	if (points.isEmpty()) {
-		return QPoint();
+void ViewerWidget::finishRender() {
+	QRegion shown = sceneRenderer.finish(*img);
+	if (!shown.isEmpty()) {
+		update(shown);
 	}
 
-	double centroidX = 0;
-	double centroidY = 0;
-	for (const QPoint& point : points) {
-		centroidX += point.x();
-		centroidY += point.y();
-	}
-
-	centroidX /= points.size();
-	centroidY /= points.size();
-
-	return QPoint(static_cast<int>(centroidX), static_cast<int>(centroidY));
+	dirtyRegion += pendingRender;
+	pendingRender = QRegion();
+	redrawDirtyRegion();
 }
 
-void ViewerWidget::scalePolygon(double scaleX, double scaleY) {
-	if (currentLayer >= 0 && currentLayer < zBuffer.size()) {
-		auto& pair = zBuffer[currentLayer];
-		if (pair.first.get().getType() == Shape::POLYGON) {
-			MyPolygon& polygon = static_cast<MyPolygon&>(pair.first.get());
-			const QVector<QPoint>& points = polygon.getPoints();
-			QPoint center = getPolygonCenter(polygon);
-
-			QVector<QPoint> scaledPoints;
-			for (const QPoint& point : points) {
-				double newX = center.x() + (point.x() - center.x()) * scaleX;
-				double newY = center.y() + (point.y() - center.y()) * scaleY;
-
-				scaledPoints.append(QPoint(static_cast<int>(std::round(newX)), static_cast<int>(std::round(newY))));
-			}
-
-			pair.first.get().setPoints(scaledPoints);
-			redrawAllShapes();
-		}
+void ViewerWidget::finishRendering() {
+	while (sceneRenderer.isBusy()) {
+		sceneRenderer.wait();
+		finishRender();
 	}
 }
 
-void ViewerWidget::movePolygon(const QPoint& offset) {
-	if (currentLayer >= 0 && currentLayer < zBuffer.size()) {
-		auto& pair = zBuffer[currentLayer];
-		qDebug() << "ShapeType: " << pair.first.get().getType();
-		if (pair.first.get().getType() == Shape::POLYGON) {
-			MyPolygon& polygon = static_cast<MyPolygon&>(pair.first.get());
-			const QVector<QPoint>& points = polygon.getPoints();
-
-			QVector<QPoint> movedPoints;
-			for (const QPoint& point : points) {
-				movedPoints.append(point + offset);
-			}
-
-			pair.first.get().setPoints(movedPoints);
-			redrawAllShapes();
-		}
-	}
+void ViewerWidget::cancelRendering() {
+	// The frame still ends through finishRender, which then has nothing left to draw
+	sceneRenderer.cancel();
+	pendingRender = QRegion();
 }
 
-void ViewerWidget::turnPolygon(int angle) {
-	if (currentLayer >= 0 && currentLayer < zBuffer.size()) {
-		auto& pair = zBuffer[currentLayer];
-		if (pair.first.get().getType() == Shape::POLYGON) {
-			MyPolygon& polygon = static_cast<MyPolygon&>(pair.first.get());
-			const QVector<QPoint>& points = polygon.getPoints();
-			QPoint center = getPolygonCenter(polygon);
-
-			double radians = qDegreesToRadians(static_cast<double>(angle));
-			double cosAngle = std::cos(radians);
-			double sinAngle = std::sin(radians);
-
-			QVector<QPoint> rotatedPoints;
-
-			for (const QPoint& point : points) {
-				// Translate the point to the origin
-				int translatedX = point.x() - center.x();
-				int translatedY = point.y() - center.y();
-
-				// Rotate the point
-				int rotatedX = static_cast<int>(translatedX * cosAngle - translatedY * sinAngle);
-				int rotatedY = static_cast<int>(translatedX * sinAngle + translatedY * cosAngle);
+void ViewerWidget::showDirectDraw(const QRect& bounds) {
+	QRect area = bounds.adjusted(-1, -1, 1, 1);
+	// The frame in flight was rendered without this drawing and would cover it when shown
+	if (sceneRenderer.isBusy()) {
+		pendingRender += area.intersected(img->rect());
+	}
+	update(area);
+}
 
-				// Translate the point back
-				rotatedX += center.x();
-				rotatedY += center.y();
+//-----------------------------------------
+//		*** Manipulation ***
+//-----------------------------------------
+void ViewerWidget::beginManipulation() {
+	endManipulation();
+	manipulationPending = !selectedIds.empty() && img;
+}
 
-				rotatedPoints.append(QPoint(rotatedX, rotatedY));
-			}
+void ViewerWidget::buildManipulation() {
+	manipulationPending = false;
 
-			pair.first.get().setPoints(rotatedPoints);
-			redrawAllShapes();
+	// Compositing the whole canvas here would stall the GUI thread on exactly the scenes whose redraws
+	// go to the render thread, so their drags keep going there
+	if (layers.size() > asyncShapeThreshold) {
+		std::vector<Shape*> reached;
+		spatialIndex.query(img->rect(), reached);
+		if (static_cast<int>(reached.size()) > asyncShapeThreshold) {
+			return;
 		}
 	}
-}
 
-QVector<QPoint> ViewerWidget::trimPolygon(Shape& polygon) {
-	QVector<QPoint> pointsVector = polygon.getPoints();
-
-	if (pointsVector.isEmpty()) {
-		qDebug() << "pointsVector je prazdny";
-		return QVector<QPoint>();
+	INSTRUMENT_SCOPE("ViewerWidget::buildManipulation");
+	int lowest = layers.size();
+	int highest = -1;
+	for (int id : selectedIds) {
+		int position = layers.positionOf(id);
+		lowest = std::min(lowest, position);
+		highest = std::max(highest, position);
 	}
 
-	QVector<QPoint> W, polygonPoints = pointsVector; // Inicializácia pomocného vektora a kópie pôvodného vektora bodov
-	QPoint S; // Pomocný bod pre prácu s bodmi polygonu
-
-	//qDebug() << "Pociatocny pointsVector:" << pointsVector;
-
-	int xMin[] = { 0,0,-499,-499 }; // Hranice orezania pre x súradnice
-
-	// Prechádzame štyri hranice orezania
-	for (int i = 0; i < 4; i++) {
-		if (pointsVector.size() == 0) {
-			//qDebug() << "pointsVector ostal prazdny, vraciam polygon:" << polygon;
-			return polygonPoints;
+	// collectShapes leaves the layers ranked by position, which splits them into the three groups
+	std::vector<Shape*> shapes;
+	collectShapes(img->rect(), shapes);
+	std::vector<Shape*> below, above;
+	for (const auto& ranked : rankedShapes) {
+		if (ranked.first < lowest) {
+			below.push_back(ranked.second);
 		}
-
-		S = polygonPoints[polygonPoints.size() - 1]; // Nastavenie S na posledný bod v polygone
-
-		// Iterácia cez všetky body polygonu
-		for (int j = 0; j < polygonPoints.size(); j++) {
-			// Logika orezania založená na pozícii bodu vzh¾adom na orezavaciu hranicu
-			if (polygonPoints[j].x() >= xMin[i]) {
-				if (S.x() >= xMin[i]) {
-					W.push_back(polygonPoints[j]);
-				}
-				else {
-					// Vytvorenie nového bodu na hranici orezania a jeho pridanie do výstupného vektora
-					QPoint P(xMin[i], S.y() + (xMin[i] - S.x()) * ((polygonPoints[j].y() - S.y()) / static_cast<double>((polygonPoints[j].x() - S.x()))));
-					W.push_back(P);
-					W.push_back(polygonPoints[j]);
-				}
-			}
-			else {
-				if (S.x() >= xMin[i]) {
-					// Vytvorenie bodu na hranici a pridanie do W, ak predchádzajúci bod bol vnútri orezanej oblasti
-					QPoint P(xMin[i], S.y() + (xMin[i] - S.x()) * ((polygonPoints[j].y() - S.y()) / static_cast<double>((polygonPoints[j].x() - S.x()))));
-					W.push_back(P);
-				}
-			}
-			S = polygonPoints[j]; // Aktualizácia S na aktuálny bod pre ïalšiu iteráciu
+		else if (ranked.first <= highest) {
+			manipulatedShapes.push_back(ranked.second);
 		}
-		//qDebug() << "Po orezavani s xMin[" << i << "] =" << xMin[i] << "W:" << W;
-		polygonPoints = W; // Nastavenie orezaného polygonu ako aktuálneho polygonu pre ïalšiu iteráciu
-		W.clear(); // Vymazanie pomocného vektora pre ïalšie použitie
-
-		// Rotácia bodov polygonu pre ïalšiu hranicu orezania
-		for (int j = 0; j < polygonPoints.size(); j++) {
-			QPoint swappingPoint = polygonPoints[j];
-			polygonPoints[j].setX(swappingPoint.y());
-			polygonPoints[j].setY(-swappingPoint.x());
+		else if (ranked.second->getBlendMode() == Shape::SOURCE_OVER) {
+			above.push_back(ranked.second);
+		}
+		else {
+			// Only source-over layers can be flattened ahead of what they cover
+			manipulatedShapes.clear();
+			return;
 		}
-		//qDebug() << "Po vymene, polygon:" << polygon;
 	}
 
-	//qDebug() << "Vysledny orezany polygon:" << polygon;
-	return polygonPoints;
+	belowLayers = QImage(img->size(), QImage::Format_ARGB32_Premultiplied);
+	tileRenderer.render(belowLayers, below, belowLayers.rect(), qRgb(255, 255, 255));
+	aboveLayers = QImage(img->size(), QImage::Format_ARGB32_Premultiplied);
+	tileRenderer.render(aboveLayers, above, aboveLayers.rect(), 0);
+	manipulating = true;
 }
 
-QVector<ViewerWidget::Edge> ViewerWidget::loadEdges(const QVector<QPoint>& points) {
-	QVector<Edge> edges;
-
-	for (int i = 0; i < points.size(); i++) {
-		// Urèenie zaèiatoèného a koncového bodu hrany
-		QPoint startPoint = points[i];
-		QPoint endPoint = points[(i + 1) % points.size()]; // Po poslednom bode, vrátenie sa na prvý
-
-		// Priame vytvorenie hrany bez manuálneho výpoètu sklonu
-		Edge edge(startPoint, endPoint);
-
-		// Upravenie koncového bodu hrany pod¾a pôvodnej logiky, ak je to potrebné
-		edge.adjustEndPoint();
-
-		edges.push_back(edge);
+void ViewerWidget::endManipulation() {
+	manipulationPending = false;
+	if (!manipulating) {
+		return;
 	}
 
-	// Prepoèet sklonu a zmena bodov prebieha v konštruktore triedy
-
-	std::sort(edges.begin(), edges.end(), compareByY); // Usporiadanie hrán pod¾a ich y-ovej súradnice
-	return edges;
+	// The last queued offsets still go through the composites, then the exact pass replaces them
+	flushPendingInput();
+	dropManipulation();
+	dirtyRegion += manipulatedRegion;
+	manipulatedRegion = QRegion();
+	redrawDirtyRegion();
 }
 
-void ViewerWidget::fillPolygon(Shape& polygon) {
-	const QVector<QPoint>& points = polygon.getPoints();
+void ViewerWidget::dropManipulation() {
+	manipulationPending = false;
+	manipulating = false;
+	belowLayers = QImage();
+	aboveLayers = QImage();
+	manipulatedShapes.clear();
+}
 
-	if (points.isEmpty()) {
-		//qDebug() << "Neobsahuje body pre vyplnanie.";
-		return;
+void ViewerWidget::recordInputLatency(double milliseconds) {
+	if (static_cast<int>(latencySamples.size()) < maxLatencySamples) {
+		latencySamples.push_back(milliseconds);
 	}
-	// Naèítanie hrán z bodov
-	QVector<Edge> edges = loadEdges(points);
-	if (edges.isEmpty()) {
-		//qDebug() << "Vektor hran je prazdny.";
-		return; // Predèasný výstup, ak neboli generované žiadne hrany
+	else {
+		latencySamples[latencyCursor] = milliseconds;
 	}
+	latencyCursor = (latencyCursor + 1) % maxLatencySamples;
+	lastLatency = milliseconds;
+	emit inputLatencyMeasured();
+}
 
-	// Inicializácia yMin a yMax na základe prvej hrany
-	int yMin = edges.front().startPoint().y();
-	int yMax = edges.front().endPoint().y();
-
-	// Nájdenie celkových yMin a yMax hodnôt
-	for (const Edge& edge : edges) {
-		int y1 = edge.startPoint().y();
-		int y2 = edge.endPoint().y();
-		yMin = qMin(yMin, qMin(y1, y2));
-		yMax = qMax(yMax, qMax(y1, y2));
+ViewerWidget::InputLatency ViewerWidget::getInputLatency() const {
+	InputLatency latency;
+	latency.frames = static_cast<int>(latencySamples.size());
+	latency.lastMs = lastLatency;
+	for (double sample : latencySamples) {
+		latency.averageMs += sample;
+		latency.worstMs = std::max(latency.worstMs, sample);
 	}
-
-	//qDebug() << "Prepocitane yMin:" << yMin << "yMax:" << yMax;
-
-	// Kontrola platnosti hodnôt yMin a yMax
-	if (yMin >= yMax) {
-		//qDebug() << "Neplatne yMin a yMax hodnoty. Mozne nespravne nastavenie hrany.";
-		return;
+	if (latency.frames > 0) {
+		latency.averageMs /= latency.frames;
 	}
+	return latency;
+}
 
-	// Tabu¾ka hrán, inicializovaná tak, aby pokrývala od yMin po yMax
-	QVector<QVector<Edge>> TH(yMax - yMin + 1);
+//-----------------------------------------
+//		*** Line functions ***
+//-----------------------------------------
+void ViewerWidget::drawLine(Line& line)
+{
+	rasterizer.drawLine(line);
+	showDirectDraw(line.getBoundingRect());
+}
 
-	//qDebug() << "yMin:" << yMin << "yMax:" << yMax;
+//-----------------------------------------
+//		*** Circle functions ***
+//-----------------------------------------
+void ViewerWidget::drawCircle(Circle& circle) {
+	rasterizer.drawCircle(circle);
+	showDirectDraw(circle.getBoundingRect());
+}
 
-	// Populácia tabu¾ky hrán
-	for (const auto& edge : edges) {
-		int index = edge.startPoint().y() - yMin; // Index založený na offsete yMin
-		if (index < 0 || index >= TH.size()) {
-			//qDebug() << "Invalid index:" << index << "for edge start point y:" << edge.startPoint().y();
-			continue;
-		}
-		TH[index].append(edge);
+//-----------------------------------------
+//		*** Polygon Functions ***
+//-----------------------------------------
+void ViewerWidget::drawPolygon(MyPolygon& polygon) {
+	if (polygon.pointSpan().size() < 2) {
+		QMessageBox::warning(this, "Nizky pocet bodov", "Nebol dosiahnuty minimalny pocet bodov pre vykreslenie polygonu.");
+		return;
 	}
 
-	QVector<Edge> activeEdgeList; // Zoznam aktívnych hrán (AEL)
-
-	// Zaèiatok prechodu scan line od yMin po yMax
-	for (int y = yMin; y <= yMax; y++) {
-		// Pridanie hrán do AEL
-		for (const auto& edge : TH[y - yMin]) {
-			activeEdgeList.append(edge);
-		}
-
-		// Zoradenie AEL pod¾a aktuálnej hodnoty X
-		std::sort(activeEdgeList.begin(), activeEdgeList.end(), [](const Edge& a, const Edge& b) {
-			return a.x() < b.x();
-			});
-
-		// Kreslenie èiar medzi pármi hodnôt X
-		for (int i = 0; i < activeEdgeList.size(); i += 2) {
-			if (i + 1 < activeEdgeList.size()) {
-				int startX = qRound(activeEdgeList[i].x());
-				int endX = qRound(activeEdgeList[i + 1].x());
-				for (int x = startX; x <= endX; x++) {
-					setPixel(x, y, fillingColor); // Vyplnenie medzi hranami
-				}
-			}
-		}
-
-		// Aktualizácia a odstránenie hrán z AEL
-		QMutableVectorIterator<Edge> it(activeEdgeList);
-		while (it.hasNext()) {
-			Edge& edge = it.next();
-			if (edge.endPoint().y() == y) {
-				it.remove(); // Odstránenie hrany, ak konèí na aktuálnej scan line
-			}
-			else {
-				edge.setX(edge.x() + edge.w()); // Aktualizácia X pre ïalšiu scan line
-			}
-		}
-	}
+	rasterizer.drawPolygon(polygon);
+	showDirectDraw(polygon.getBoundingRect());
 }
 
 //-----------------------------------------
@@ -978,135 +829,13 @@ void ViewerWidget::fillPolygon(Shape& polygon) {
 //-----------------------------------------
 
 void ViewerWidget::drawCurve(BezierCurve& curve) {
-	// << Beziérova krivka >>
-	borderColor = curve.getBorderColor();
-	fillingColor = curve.getFillingColor();
-	const QVector<QPoint>& curvePoints = curve.getPoints();
-	if (curvePoints.size() < 2) {
+	if (curve.pointSpan().size() < 2) {
 		QMessageBox::warning(this, "Nedostatocny pocet bodov", "Nemozno nakreslit krivku s menej ako dvomi riadiacimi bodmi.", QMessageBox::Ok);
 		return;
 	}
 
-	painter->setPen(QPen(borderColor));
-	float deltaT = 0.01f;
-	QPoint Q0 = curvePoints[0];
-
-	std::vector<Line> lines;
-
-	for (float t = deltaT; t <= 1; t += deltaT) {
-		QVector<QPoint> tempPoints = curvePoints;
-
-		for (int i = 1; i < tempPoints.size(); i++) {
-			for (int j = 0; j < tempPoints.size() - i; j++) {
-				tempPoints[j] = tempPoints[j] * (1 - t) + tempPoints[j + 1] * t;
-			}
-		}
-
-		lines.emplace_back(Q0, tempPoints[0], curve.getZBufferPosition(), curve.getIsFilled(), borderColor, fillingColor);
-		Q0 = tempPoints[0];
-	}
-	if (deltaT * floor(1 / deltaT) < 1) {
-		lines.emplace_back(Q0, curvePoints.last(), curve.getZBufferPosition(), curve.getIsFilled(), borderColor, fillingColor);
-	}
-
-	for (Line& line : lines) {
-		drawLine(line);
-	}
-}
-
-void ViewerWidget::moveCurve(const QPoint& offset) {
-	if (currentLayer >= 0 && currentLayer < zBuffer.size()) {
-		auto& pair = zBuffer[currentLayer];
-		if (pair.first.get().getType() == Shape::BEZIER_CURVE) {
-			BezierCurve& curve = static_cast<BezierCurve&>(pair.first.get());
-			const QVector<QPoint>& points = curve.getPoints();
-
-			QVector<QPoint> movedPoints;
-			for (const QPoint& point : points) {
-				movedPoints.append(point + offset);
-			}
-
-			pair.first.get().setPoints(movedPoints);
-			redrawAllShapes();
-		}
-	}
-}
-
-void ViewerWidget::scaleCurve(double scaleX, double scaleY) {
-	if (currentLayer >= 0 && currentLayer < zBuffer.size()) {
-		auto& pair = zBuffer[currentLayer];
-		if (pair.first.get().getType() == Shape::BEZIER_CURVE) {
-			BezierCurve& curve = static_cast<BezierCurve&>(pair.first.get());
-			const QVector<QPoint>& points = curve.getPoints();
-			QPoint center = calculateCurveCenter(curve);
-
-			QVector<QPoint> scaledPoints;
-			for (const QPoint& point : points) {
-				double newX = center.x() + (point.x() - center.x()) * scaleX;
-				double newY = center.y() + (point.y() - center.y()) * scaleY;
-
-				scaledPoints.append(QPoint(static_cast<int>(std::round(newX)), static_cast<int>(std::round(newY))));
-			}
-
-			pair.first.get().setPoints(scaledPoints);
-			redrawAllShapes();
-		}
-	}
-}
-
-void ViewerWidget::turnCurve(int angle) {
-	if (currentLayer >= 0 && currentLayer < zBuffer.size()) {
-		auto& pair = zBuffer[currentLayer];
-		if (pair.first.get().getType() == Shape::BEZIER_CURVE) {
-			BezierCurve& curve = static_cast<BezierCurve&>(pair.first.get());
-			const QVector<QPoint>& points = curve.getPoints();
-			QPoint center = calculateCurveCenter(curve);
-
-			double radians = qDegreesToRadians(static_cast<double>(angle));
-			double cosAngle = std::cos(radians);
-			double sinAngle = std::sin(radians);
-
-			QVector<QPoint> rotatedPoints;
-
-			for (const QPoint& point : points) {
-				// Translate the point to the origin
-				int translatedX = point.x() - center.x();
-				int translatedY = point.y() - center.y();
-
-				// Rotate the point
-				int rotatedX = static_cast<int>(translatedX * cosAngle - translatedY * sinAngle);
-				int rotatedY = static_cast<int>(translatedX * sinAngle + translatedY * cosAngle);
-
-				// Translate the point back
-				rotatedX += center.x();
-				rotatedY += center.y();
-
-				rotatedPoints.append(QPoint(rotatedX, rotatedY));
-			}
-
-			pair.first.get().setPoints(rotatedPoints);
-			redrawAllShapes();
-		}
-	}
-}
-
-QPoint ViewerWidget::calculateCurveCenter(BezierCurve& curve) const {
-	const QVector<QPoint>& points = curve.getPoints();
-	if (points.isEmpty()) {
-		return QPoint();
-	}
-
-	double centroidX = 0;
-	double centroidY = 0;
-	for (const QPoint& point : points) {
-		centroidX += point.x();
-		centroidY += point.y();
-	}
-
-	centroidX /= points.size();
-	centroidY /= points.size();
-
-	return QPoint(static_cast<int>(centroidX), static_cast<int>(centroidY));
+	rasterizer.drawCurve(curve);
+	showDirectDraw(curve.getBoundingRect());
 }
 
 //-----------------------------------------
@@ -1114,135 +843,11 @@ QPoint ViewerWidget::calculateCurveCenter(BezierCurve& curve) const {
 //-----------------------------------------
 
 void ViewerWidget::drawRectangle(MyRectangle& rectangle) {
-	borderColor = rectangle.getBorderColor();
-	fillingColor = rectangle.getFillingColor();
-	const QVector<QPoint>& pointsVector = rectangle.getPoints();
-
-	if (pointsVector.size() < 2) {
+	if (rectangle.pointSpan().size() < 2) {
 		QMessageBox::warning(this, "Insufficient Points", "Not enough points to render the rectangle.");
 		return;
 	}
 
-	painter->setPen(QPen(borderColor));
-
-	QVector<QPoint> rectanglePoints = rectangle.getPoints();
-
-	// Check if all points are outside the drawing area
-	bool allPointsOutside = std::all_of(pointsVector.begin(), pointsVector.end(), [this](const QPoint& point) {
-		return !isInside(point);
-		});
-
-	if (allPointsOutside) {
-		qDebug() << "Rectangle is outside the boundary.";
-		return;
-	}
-
-	// Check each point to see if it is inside the drawing area, and trim if necessary
-	for (const QPoint& point : rectanglePoints) {
-		if (!isInside(point)) {
-			rectanglePoints = trimPolygon(rectangle); // Trim the rectangle if any points are outside the boundary
-			break;
-		}
-	}
-
-	if (rectangle.getIsFilled()) {
-		fillPolygon(rectangle);
-	}
-	painter->setPen(QPen(borderColor));
-
-	std::vector<Line> lines;
-	if (!rectanglePoints.isEmpty()) {
-		lines.emplace_back(rectanglePoints.at(0), rectanglePoints.at(1), rectangle.getZBufferPosition(), rectangle.getIsFilled(), borderColor, fillingColor);
-		lines.emplace_back(rectanglePoints.at(1), rectanglePoints.at(2), rectangle.getZBufferPosition(), rectangle.getIsFilled(), borderColor, fillingColor);
-		lines.emplace_back(rectanglePoints.at(2), rectanglePoints.at(3), rectangle.getZBufferPosition(), rectangle.getIsFilled(), borderColor, fillingColor);
-		lines.emplace_back(rectanglePoints.at(3), rectanglePoints.at(0), rectangle.getZBufferPosition(), rectangle.getIsFilled(), borderColor, fillingColor);
-	}
-	for (Line& line : lines) {
-		drawLine(line);
-	}
-
-	update();
-}
-
-void ViewerWidget::moveRectangle(const QPoint& offset) {
-	qDebug() << "Current Layer: " << currentLayer;
-	qDebug() << "Z-Buffer Size: " << zBuffer.size();
-	if (currentLayer >= 0 && currentLayer < zBuffer.size()) {
-		auto& pair = zBuffer[currentLayer];
-		qDebug() << "ShapeType: " << pair.first.get().getType();
-		if (pair.first.get().getType() == Shape::RECTANGLE) {
-			MyRectangle& rectangle = static_cast<MyRectangle&>(pair.first.get());
-			const QVector<QPoint>& points = rectangle.getPoints();
-
-			QVector<QPoint> movedPoints;
-			for (const QPoint& point : points) {
-				movedPoints.append(point + offset);
-			}
-
-			for (const QPoint& point : movedPoints) {
-				qDebug() << "Rectangle Point: " << point.x() << "," << point.y();
-			}
-
-			pair.first.get().setPoints(movedPoints);
-			redrawAllShapes();
-		}
-	}
-}
-
-void ViewerWidget::scaleRectangle(double scaleX, double scaleY) {
-	if (currentLayer >= 0 && currentLayer < zBuffer.size()) {
-		auto& pair = zBuffer[currentLayer];
-		if (pair.first.get().getType() == Shape::RECTANGLE) {
-			MyRectangle& rectangle = static_cast<MyRectangle&>(pair.first.get());
-			const QVector<QPoint>& points = rectangle.getPoints();
-			QPoint center = getPolygonCenter(rectangle);
-
-			QVector<QPoint> scaledPoints;
-			for (const QPoint& point : points) {
-				double newX = center.x() + (point.x() - center.x()) * scaleX;
-				double newY = center.y() + (point.y() - center.y()) * scaleY;
-
-				scaledPoints.append(QPoint(static_cast<int>(std::round(newX)), static_cast<int>(std::round(newY))));
-			}
-
-			pair.first.get().setPoints(scaledPoints);
-			redrawAllShapes();
-		}
-	}
-}
-
-void ViewerWidget::turnRectangle(int angle) {
-	if (currentLayer >= 0 && currentLayer < zBuffer.size()) {
-		auto& pair = zBuffer[currentLayer];
-		if (pair.first.get().getType() == Shape::RECTANGLE) {
-			MyRectangle& rectangle = static_cast<MyRectangle&>(pair.first.get());
-			const QVector<QPoint>& points = rectangle.getPoints();
-			QPoint center = getPolygonCenter(rectangle);
-
-			double radians = qDegreesToRadians(static_cast<double>(angle));
-			double cosAngle = std::cos(radians);
-			double sinAngle = std::sin(radians);
-
-			QVector<QPoint> rotatedPoints;
-
-			for (const QPoint& point : points) {
-				// Translate the point to the origin
-				int translatedX = point.x() - center.x();
-				int translatedY = point.y() - center.y();
-
-				// Rotate the point
-				int rotatedX = static_cast<int>(translatedX * cosAngle - translatedY * sinAngle);
-				int rotatedY = static_cast<int>(translatedX * sinAngle + translatedY * cosAngle);
-
-				// Translate the point back
-				rotatedX += center.x();
-				rotatedY += center.y();
-
-				rotatedPoints.append(QPoint(rotatedX, rotatedY));
-			}
-
-			pair.first.get().setPoints(rotatedPoints);
-			redrawAllShapes();
-		}
-	}
+	rasterizer.drawRectangle(rectangle);
+	showDirectDraw(rectangle.getBoundingRect());
 }
\ No newline at end of file
@@ -5,6 +5,15 @@
 #include <QVector3D>
 #include "lighting.h"
 #include "representation.h"
+#include "compositing.h"
+#include "rasterizer.h"
+#include "tilerenderer.h"
+#include "scenerenderer.h"
+#include "scenejournal.h"
+#include "sceneio.h"
+#include "spatialindex.h"
+#include "layerstack.h"
+#include "shapepool.h"
 
 struct ClippedLine {
 	QVector<QPoint> points;
@@ -18,6 +27,7 @@ private:
 	QImage* img = nullptr;
 	QPainter* painter = nullptr;
 	uchar* data = nullptr;
+	int bytesPerLine = 0;
 
 	bool drawLineActivated = false;
 	bool drawCircleActivated = false;
@@ -29,10 +39,77 @@ private:
 	QPoint moveStart = QPoint(0, 0);
 	QVector<QPoint> originalPointsVector;
 
-	std::vector<std::pair<std::reference_wrapper<Shape>, int>> zBuffer;
+	// Owns every shape of the scene, including one still being drawn
+	ShapePool shapePool;
+	LayerStack layers;
 	int currentLayer;
 	QColor borderColor, fillingColor;
 
+	Rasterizer rasterizer;
+	TileRenderer tileRenderer;
+	LayerCache layerCache;
+	QRegion dirtyRegion;
+
+	// Bounds of every layer, for culling and picking
+	SpatialIndex spatialIndex;
+	std::vector<std::pair<int, Shape*>> rankedShapes;
+	// Layer ids, see LayerStack
+	std::vector<int> selectedIds;
+	// Past this many pieces the dirty region is redrawn as its bounding rectangle
+	static const int maxDirtyRects = 16;
+
+	// Background rendering: redraws reaching more shapes than this render from a snapshot on the render
+	// thread. Redraws asked for meanwhile collect in pendingRender and follow once the frame is shown.
+	static const int asyncShapeThreshold = 20000;
+	SceneRenderer sceneRenderer;
+	QRegion pendingRender;
+
+	// Input coalescing: drag offsets and wheel steps add up here and are applied at most once per frame
+	static const int frameIntervalMs = 16;
+	QTimer frameTimer;
+	QElapsedTimer frameClock;
+	QPoint pendingOffset;
+	double pendingScale = 1.0;
+	bool hasPendingInput = false;
+
+	// Input to photon latency: from the first input of a frame until the paint that shows it
+	static const int maxLatencySamples = 120;
+	QElapsedTimer inputClock;
+	QElapsedTimer presentClock;
+	bool awaitingPresent = false;
+	std::vector<double> latencySamples;
+	int latencyCursor = 0;
+	double lastLatency = 0.0;
+
+	// Manipulation: the layers under and over the selected range, composited once when a drag starts
+	// moving; pending from the press until then
+	bool manipulationPending = false;
+	bool manipulating = false;
+	QImage belowLayers;
+	QImage aboveLayers;
+	std::vector<Shape*> manipulatedShapes;
+	QRegion manipulatedRegion;
+
+	// Autosave: every edit goes to the journal, which is written out once per interval
+	static const int journalFlushMs = 1000;
+	SceneJournal journal;
+	QTimer journalTimer;
+
+	void collectShapes(const QRect& area, std::vector<Shape*>& shapes);
+	void requestLayerMasks(const QRect& area);
+	QPointF selectionCenter() const;
+	void transformSelection(const QTransform& transform);
+	void scheduleFrame();
+	void flushPendingInput();
+	void flushJournal();
+	void recordInputLatency(double milliseconds);
+	void buildManipulation();
+	void dropManipulation();
+	void startRender(const QRegion& region);
+	void finishRender();
+	void cancelRendering();
+	void showDirectDraw(const QRect& bounds);
+
 public:
 	ViewerWidget(QSize imgSize, QWidget* parent = Q_NULLPTR);
 	~ViewerWidget();
@@ -45,140 +122,99 @@ public:
 	bool isEmpty();
 	bool changeSize(int width, int height);
 	void changeLayerColor(int zBufferPosition, const QColor& newBorderColor, const QColor& newFillingColor);
+	void changeLayerBlending(int zBufferPosition, Shape::BlendMode newBlendMode, double newOpacity);
 
 	void setPixel(int x, int y, uchar r, uchar g, uchar b, uchar a = 255);
 	void setPixel(int x, int y, double valR, double valG, double valB, double valA = 1.);
 	void setPixel(int x, int y, const QColor& color);
-	bool isInside(QPoint point) { return (point.x() > 0 && point.y() > 0 && point.x() < img->width() - 1 && point.y() < img->height() - 1) ? true : false; }
-	bool isInside(int x, int y) { return (x > 0 && y > 0 && x < img->width() && y < img->height()) ? true : false; }
+	bool isInside(QPoint point) { return rasterizer.isInside(point); }
+	bool isInside(int x, int y) { return rasterizer.isInside(x, y); }
 
 	//Draw functions
 	void drawShape(Shape& shape);
 	void moveShapeUp(int zBufferPosition);
 	void moveShapeDown(int zBufferPosition);
 	void addToZBuffer(Shape& shape, int depth);
+	// Bulk load: one ordering pass for the whole batch instead of one insertion per shape
+	void addToZBuffer(const std::vector<std::pair<Shape*, int>>& shapes);
 	void redrawAllShapes();
 
+	//	Picking: zBuffer position of the topmost shape drawn within tolerance of point, or -1
+	int layerAt(const QPoint& point, int tolerance = 3);
+	Shape::ShapeType getShapeType(int zBufferPosition) const { return layers.at(zBufferPosition)->getType(); }
+
+	//	Dirty region: edits mark the bounds they touch, then one redraw repaints and updates only that area
+	void markDirty(const QRect& rect);
+	void transformShape(Shape& shape, const QTransform& transform);
+	void redrawDirtyRegion();
+	//	Blocks until every redraw asked for so far has reached the image, e.g. before the image is saved
+	void finishRendering();
+	bool isRendering() const { return sceneRenderer.isBusy(); }
+
+	//	Selection: the layers transforms act on, kept by layer id so restacking does not disturb it.
+	//	Each transform edits the whole selection and then redraws once.
+	void setSelection(const QVector<int>& zBufferPositions);
+	bool isSelected(int zBufferPosition) const;
+	//	Selects the layers lying wholly inside rect and returns their zBuffer positions
+	QVector<int> selectInRect(const QRect& rect);
+	//	Turning and scaling keep the selection's center in place
+	void turnSelection(int angle);
+	void scaleSelection(double scaleX, double scaleY);
+
+	//	Coalesced variants for high-rate input such as mouse drags and wheel steps: the edits queue up
+	//	and the next frame applies their sum, so the drawing keeps up with the pointer at any scene size
+	void queueMoveSelection(const QPoint& offset);
+	void queueScaleSelection(double factor);
+
+	//	Manipulation mode for drags: between begin and end, redraws rasterize only the selected range of
+	//	layers between cached composites of the rest. The composites are built by the first queued input,
+	//	so a click without a drag costs nothing; scenes heavy enough for the render thread skip them and
+	//	keep the plain redraw. Ending it redraws the touched area exactly once.
+	void beginManipulation();
+	void endManipulation();
+	bool isManipulating() const { return manipulating; }
+
+	//	Over the last frames drawn from queued input, in milliseconds
+	struct InputLatency {
+		int frames = 0;
+		double lastMs = 0.0;
+		double averageMs = 0.0;
+		double worstMs = 0.0;
+	};
+	InputLatency getInputLatency() const;
+
+	//	Layer cache: reorder, recolor and delete re-composite cached coverage instead of re-rasterizing
+	void setLayerCacheEnabled(bool state) { layerCache.setEnabled(state); }
+	bool isLayerCacheEnabled() const { return layerCache.isEnabled(); }
+
 	//	Lines
 	void drawLine(Line& line);
 	void setDrawLineBegin(QPoint begin) { drawLineBegin = begin; }
 	QPoint getDrawLineBegin() { return drawLineBegin; }
 	void setDrawLineActivated(bool state) { drawLineActivated = state; }
 	bool getDrawLineActivated() { return drawLineActivated; }
-	void drawLineBresenham(QVector<QPoint>& linePoints);
-	void moveLine(const QPoint& offset);
-	void turnLine(int angle);
-	QPoint getLineCenter(Line& line) const;
-	void scaleLine(double scaleX, double scaleY);
 	
 	//	Circles
 	void drawCircle(Circle& circle);
-	void drawSymmetricPoints(const QPoint& center, int x, int y);
-	void drawSymmetricPointsFilled(const QPoint& center, int x, int y);
 	void setDrawCircleActivated(bool state) { drawCircleActivated = state; }
 	bool getDrawCircleActivated() { return drawCircleActivated; }
 	void setDrawCircleCenter(QPoint center) { drawCircleCenter = center; }
 	QPoint getDrawCircleCenter() { return drawCircleCenter; }
-	void moveCircle(const QPoint& offset);
-	void scaleCircle(double scaleX, double scaleY);
 
 	// Polygons
 	void drawPolygon(MyPolygon& polygon);
 	void setMoveStart(QPoint start) { moveStart = start; };
 	QPoint getMoveStart() { return moveStart; }
-	void movePolygon(const QPoint& offset);
-	void turnPolygon(int angle);
-	QPoint getPolygonCenter(Shape& polygon) const;
-	void scalePolygon(double scaleX, double scaleY);
-	
-	//  **Trimming functions**
-	QVector<QPoint> trimPolygon(Shape& polygon);
-	void clipLineWithPolygon(QVector<QPoint> linePoints);
-
-	//	**Polygon filling handling**
-
-	//	<Subclass for edges>
-	class Edge {
-	private:
-		QPoint startPoint_;  // Zaèiatoèný bod hrany
-		QPoint endPoint_;    // Koncový bod hrany
-		double slope_;       // Sklon hrany
-		double x_;           // Aktuálna x pozícia pre vyplòovanie pomocou ScanLine algoritmu
-		double w_;           // Inverzný sklon pre aktualizáciu x
-
-	public:
-		// Konštruktor prijíma zaèiatoèný a koncový bod hrany a inicializuje èlenské premenné
-		Edge() : startPoint_(QPoint(0, 0)), endPoint_(QPoint(0, 0)), slope_(0.0), x_(0.0), w_(0.0) {}
-		Edge(QPoint start, QPoint end) : startPoint_(start), endPoint_(end), x_(0.0), w_(0.0) {
-			calculateAttributes();
-		}
-
-		// Výpoèet atribútov hrany (sklon, inverzný sklon)
-		void calculateAttributes() {
-			double dx = static_cast<double>(endPoint_.x() - startPoint_.x());
-			double dy = static_cast<double>(endPoint_.y() - startPoint_.y());
-
-			if (dx == 0) {
-				slope_ = std::numeric_limits<double>::max(); // Nastavenie smernice/sklonu na maximálnu hodnotu pre double, reprezentuje vertikálny sklon
-				w_ = 0; // Pre vertikálne hrany je inverzný sklon nulový
-			}
-			else {
-				slope_ = dy / dx; // Výpoèet sklonu ako pomer zmeny y k zmene x
-				w_ = 1.0 / slope_; // Výpoèet inverzného sklonu
-			}
-
-			x_ = static_cast<double>(startPoint_.x());
-
-			// y-ová súradnica zaèiatoèného bodu je vždy menšia ako y-ová súradnica koncového bodu
-			if (startPoint_.y() > endPoint_.y()) {
-				swapStartEndPoints();
-				calculateAttributes(); // Rekurzívny prepoèet atribútov, ak došlo k výmene bodov
-			}
-		}
-
-		// Metóda pre výmenu zaèiatoèného a koncového bodu
-		void swapStartEndPoints() {
-			std::swap(startPoint_, endPoint_);
-		}
-
-		// Úprava koncového bodu hrany o -1 na y-ovej súradnici, použitie po naèítaní hrán
-		void adjustEndPoint() {
-			endPoint_.setY(endPoint_.y() - 1);
-		}
-
-		// Gettery pre prístup k èlenským premenným
-		QPoint startPoint() const { return startPoint_; }
-		QPoint endPoint() const { return endPoint_; }
-		double slope() const { return slope_; }
-		double x() const { return x_; }
-		double w() const { return w_; }
-
-		// Setter pre nastavenie aktuálnej x-ovej pozície
-		void setX(double x) { x_ = x; }
-	};
-
-	static bool compareByY(const Edge& edge1, const Edge& edge2){ return edge1.startPoint().y() < edge2.startPoint().y(); }
-	static bool compareByX(const Edge& edge1, const Edge& edge2){ return edge1.x() < edge2.x(); }
 	
-	void fillPolygon(Shape& polygon);
-	QVector<Edge> loadEdges(const QVector<QPoint>& points);
-
 	//	** Curve function declarations **
 	void drawCurve(BezierCurve& curve);
-	void moveCurve(const QPoint& offset);
-	void scaleCurve(double scaleX, double scaleY);
-	void turnCurve(int angle);
-	QPoint calculateCurveCenter(BezierCurve& curve) const;
 
 	//	Rectangles
 	void drawRectangle(MyRectangle& rectangle);
-	void moveRectangle(const QPoint& offset);
-	void scaleRectangle(double scaleX, double scaleY);
-	void turnRectangle(int angle);
 
 	//Get/Set functions
 	uchar* getData() { return data; }
-	void setDataPtr() { data = img->bits(); }
+	void setDataPtr() { data = img->bits(); bytesPerLine = img->bytesPerLine(); rasterizer.setTarget(data, img->width(), img->height(), bytesPerLine); }
 	void setPainter() { painter = new QPainter(img); }
 	void setBorderColor(QColor border) { borderColor = border; }
 	void setFillingColor(QColor filling) { fillingColor = filling; }
@@ -192,11 +228,24 @@ public:
 	int getImgWidth() { return img->width(); };
 	int getImgHeight() { return img->height(); };
 
-	void clearZBuffer() { zBuffer.clear(); }
+	ShapePool& getShapePool() { return shapePool; }
+	void clearZBuffer() { layers.clear(); layerCache.clear(); spatialIndex.clear(); shapePool.clear(); selectedIds.clear(); pendingOffset = QPoint(); pendingScale = 1.0; dropManipulation(); cancelRendering(); journal.recordClear(); }
 	void clear();
 	void deleteObjectFromZBuffer(int currentIndex);
 	void saveCurrentImageState();
+	int getLayerCount() const { return layers.size(); }
+	int getLayerDepth(int zBufferPosition) const { return layers.depthAt(zBufferPosition); }
+	//	Depth for a new shape: above every layer, so its zBuffer position matches the list row appended for it
+	int getNextLayerDepth() const { return layers.nextDepth(); }
+
+	//	Autosave: replays the scene journaled in directory, if any, and journals every edit from then on
+	bool restoreSession(const QString& directory);
 
 public slots:
 	void paintEvent(QPaintEvent* event) Q_DECL_OVERRIDE;
+
+signals:
+	void inputLatencyMeasured();
+	//	The autosave journal stopped after failing to write; edits from here on are not autosaved
+	void autosaveFailed();
 };
@@ -0,0 +1,222 @@
+// Headless batch renderer: rasterizes scene files saved by the viewer into images without a window.
+//
+//	batchrender [-o dir] [-s WxH] [-f png] [-j jobs] <scene.csv | scene.ivs | directory>...
+//
+// Files are rendered in parallel, one per pool thread; a single file is split into tiles across all cores instead.
+// Of a binary scene only the shapes reaching into the canvas are loaded, found through the file's own index.
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QImage>
+#include <QMutex>
+#include <QRunnable>
+#include <QSet>
+#include <QThread>
+#include <QThreadPool>
+#include <algorithm>
+#include <cstdio>
+#include "instrumentation.h"
+#include "sceneio.h"
+#include "tilerenderer.h"
+
+namespace {
+
+struct BatchOptions {
+	QSize canvasSize = QSize(500, 500);
+	QString outputDir;
+	QString format = "png";
+	int tileThreads = 1;
+};
+
+struct BatchTotals {
+	QMutex mutex;
+	int renderedFiles = 0;
+	int failedFiles = 0;
+	qint64 shapes = 0;
+	qint64 pixels = 0;
+};
+
+class RenderFileJob : public QRunnable {
+public:
+	RenderFileJob(const QString& inputPath, const QString& outputPath, const BatchOptions& options, BatchTotals& totals)
+		: inputPath(inputPath), outputPath(outputPath), options(options), totals(totals) {}
+
+	void run() override
+	{
+		QElapsedTimer timer;
+		timer.start();
+
+		ShapePool pool;
+		SceneFile scene;
+		if (!loadScene(inputPath, scene, pool, QRect(QPoint(0, 0), options.canvasSize))) {
+			report(QString("%1: unable to open file for reading").arg(inputPath), false, 0);
+			return;
+		}
+		qint64 parseNs = timer.nsecsElapsed();
+
+		// Same order as ViewerWidget::addToZBuffer
+		std::stable_sort(scene.shapes.begin(), scene.shapes.end(), [](const std::pair<Shape*, int>& a, const std::pair<Shape*, int>& b) {
+			return a.second < b.second;
+			});
+		std::vector<Shape*> shapes;
+		shapes.reserve(scene.shapes.size());
+		for (const auto& entry : scene.shapes) {
+			shapes.push_back(entry.first);
+		}
+
+		QImage image(options.canvasSize, QImage::Format_ARGB32_Premultiplied);
+		TileRenderer renderer;
+		renderer.setMaxThreadCount(options.tileThreads);
+		renderer.render(image, shapes, image.rect(), qRgb(255, 255, 255));
+		qint64 renderNs = timer.nsecsElapsed() - parseNs;
+
+		bool saved = image.save(outputPath, options.format.toStdString().c_str());
+		qint64 writeNs = timer.nsecsElapsed() - parseNs - renderNs;
+
+		QString line = QString("%1 -> %2: %3 shapes, parse %4 ms, render %5 ms, write %6 ms")
+			.arg(inputPath, outputPath)
+			.arg(shapes.size())
+			.arg(parseNs / 1e6, 0, 'f', 2)
+			.arg(renderNs / 1e6, 0, 'f', 2)
+			.arg(writeNs / 1e6, 0, 'f', 2);
+		if (scene.formatError) {
+			line += ", stopped at an invalid line";
+		}
+		if (scene.invalidShapes > 0) {
+			line += QString(", %1 invalid shapes skipped").arg(scene.invalidShapes);
+		}
+		if (!saved) {
+			line += ", unable to write image";
+		}
+		report(line, saved, static_cast<qint64>(shapes.size()));
+	}
+
+private:
+	void report(const QString& line, bool success, qint64 shapeCount)
+	{
+		QMutexLocker locker(&totals.mutex);
+		if (success) {
+			totals.renderedFiles++;
+			totals.shapes += shapeCount;
+			totals.pixels += static_cast<qint64>(options.canvasSize.width()) * options.canvasSize.height();
+		}
+		else {
+			totals.failedFiles++;
+		}
+		std::fprintf(success ? stdout : stderr, "%s\n", qPrintable(line));
+		std::fflush(success ? stdout : stderr);
+	}
+
+	QString inputPath;
+	QString outputPath;
+	const BatchOptions& options;
+	BatchTotals& totals;
+};
+
+QString outputPathFor(const QString& inputPath, const BatchOptions& options)
+{
+	QFileInfo info(inputPath);
+	QString outputDir = options.outputDir.isEmpty() ? info.absolutePath() : options.outputDir;
+	return QDir(outputDir).filePath(info.completeBaseName() + "." + options.format);
+}
+
+QStringList collectSceneFiles(const QStringList& arguments)
+{
+	QStringList files;
+	for (const QString& argument : arguments) {
+		QFileInfo info(argument);
+		if (info.isDir()) {
+			for (const QFileInfo& entry : QDir(argument).entryInfoList(QStringList() << "*.csv" << "*.ivs", QDir::Files, QDir::Name)) {
+				files.append(entry.filePath());
+			}
+		}
+		else {
+			files.append(argument);
+		}
+	}
+	return files;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+	QLocale::setDefault(QLocale::c());
+
+	QCoreApplication app(argc, argv);
+	INSTRUMENT_SESSION(QString::fromLocal8Bit(qgetenv("IMAGEVIEWER_TRACE")));
+	QCoreApplication::setOrganizationName("MPM");
+	QCoreApplication::setApplicationName("ImageViewer batch renderer");
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Renders scene files saved by ImageViewer to images.");
+	parser.addHelpOption();
+	QCommandLineOption outputOption(QStringList() << "o" << "output", "Directory for the rendered images (default: next to each scene).", "dir");
+	QCommandLineOption sizeOption(QStringList() << "s" << "size", "Canvas size (default: 500x500).", "WxH", "500x500");
+	QCommandLineOption formatOption(QStringList() << "f" << "format", "Image format (default: png).", "format", "png");
+	QCommandLineOption jobsOption(QStringList() << "j" << "jobs", "Number of files rendered at once (default: all cores).", "n");
+	parser.addOption(outputOption);
+	parser.addOption(sizeOption);
+	parser.addOption(formatOption);
+	parser.addOption(jobsOption);
+	parser.addPositionalArgument("scenes", "Scene files or directories containing *.csv and *.ivs scenes.", "<scene.csv | scene.ivs | directory>...");
+	parser.process(app);
+
+	BatchOptions options;
+	options.outputDir = parser.value(outputOption);
+	options.format = parser.value(formatOption);
+
+	QStringList size = parser.value(sizeOption).split('x');
+	if (size.size() != 2 || size[0].toInt() <= 0 || size[1].toInt() <= 0) {
+		std::fprintf(stderr, "Invalid canvas size: %s\n", qPrintable(parser.value(sizeOption)));
+		return 2;
+	}
+	options.canvasSize = QSize(size[0].toInt(), size[1].toInt());
+
+	if (!options.outputDir.isEmpty() && !QDir().mkpath(options.outputDir)) {
+		std::fprintf(stderr, "Unable to create output directory: %s\n", qPrintable(options.outputDir));
+		return 2;
+	}
+
+	QStringList files = collectSceneFiles(parser.positionalArguments());
+	if (files.isEmpty()) {
+		parser.showHelp(1);
+	}
+
+	int cores = std::max(1, QThread::idealThreadCount());
+	int jobs = parser.isSet(jobsOption) ? std::max(1, parser.value(jobsOption).toInt()) : cores;
+	jobs = std::min(jobs, static_cast<int>(files.size()));
+	// Cores not taken by whole files are spent on tiles within each file
+	options.tileThreads = std::max(1, cores / jobs);
+
+	BatchTotals totals;
+	QElapsedTimer timer;
+	timer.start();
+
+	QThreadPool pool;
+	pool.setMaxThreadCount(jobs);
+	// scene.csv and scene.ivs, or same-named scenes gathered into one -o directory, would render to one image
+	// from different threads; the first keeps it and the rest fail
+	QSet<QString> outputs;
+	for (const QString& file : files) {
+		QString outputPath = outputPathFor(file, options);
+		QString key = QDir::cleanPath(QFileInfo(outputPath).absoluteFilePath());
+		if (outputs.contains(key)) {
+			std::fprintf(stderr, "%s: output %s is already written by another scene\n", qPrintable(file), qPrintable(outputPath));
+			totals.failedFiles++;
+			continue;
+		}
+		outputs.insert(key);
+		pool.start(new RenderFileJob(file, outputPath, options, totals));
+	}
+	pool.waitForDone();
+
+	double seconds = std::max(timer.nsecsElapsed() / 1e9, 1e-9);
+	std::fprintf(stdout, "%d files rendered, %d failed in %.3f s: %.1f files/s, %.0f shapes/s, %.1f Mpixel/s\n",
+		totals.renderedFiles, totals.failedFiles, seconds,
+		totals.renderedFiles / seconds, totals.shapes / seconds, totals.pixels / seconds / 1e6);
+
+	return totals.failedFiles > 0 ? 1 : 0;
+}
@@ -0,0 +1,564 @@
+// Microbenchmarks for the rasterization kernels.
+//
+//	benchmarks [--filter text] [--min-time ms] [--max-shapes n] [--size WxH] [--json file]
+//
+// Every case is timed for at least --min-time and reported as ns per call, ns per written pixel and
+// calls (shapes) per second. Pixel counts come from a coverage-mode pass of the same case, so they
+// count every blend, including pixels hit twice. Results are also written as JSON for regression tracking.
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QImage>
+#include <QTextStream>
+#include <QThread>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <random>
+#include "layerstack.h"
+#include "rasterizer.h"
+#include "spatialindex.h"
+#include "tilerenderer.h"
+
+namespace {
+
+struct BenchmarkResult {
+	QString name;
+	qint64 iterations = 0;
+	double nsPerCall = 0;
+	double pixelsPerCall = 0;
+	double shapesPerCall = 0;
+};
+
+class BenchmarkSuite {
+public:
+	BenchmarkSuite(const QSize& canvasSize, double minTimeMs, const QString& filter)
+		: image(canvasSize, QImage::Format_ARGB32_Premultiplied), minTimeNs(minTimeMs * 1e6), filter(filter)
+	{
+		image.fill(Qt::white);
+		rasterizer.setTarget(image.bits(), image.width(), image.height(), image.bytesPerLine());
+		mask.resize(static_cast<size_t>(image.width()) * image.height());
+	}
+
+	QImage& canvas() { return image; }
+	Rasterizer& target() { return rasterizer; }
+	const std::vector<BenchmarkResult>& getResults() const { return results; }
+
+	bool selected(const QString& name) const { return filter.isEmpty() || name.contains(filter); }
+
+	// Pixels written by one call of draw, measured by replaying it into a coverage mask
+	double countPixels(const std::function<void(Rasterizer&)>& draw)
+	{
+		std::fill(mask.begin(), mask.end(), 0);
+		Rasterizer counter(nullptr, image.width(), image.height(), 0);
+		counter.setCoverageTarget(mask.data(), image.rect());
+		draw(counter);
+
+		double pixels = 0;
+		for (uchar hits : mask) {
+			pixels += (hits >> 4) + (hits & 0x0f);
+		}
+		return pixels;
+	}
+
+	void run(const QString& name, double pixelsPerCall, double shapesPerCall, const std::function<void()>& body)
+	{
+		if (!selected(name)) {
+			return;
+		}
+
+		// Warm up once, then double the batch until it runs long enough to time
+		body();
+		qint64 iterations = 1;
+		qint64 elapsed = 0;
+		while (true) {
+			QElapsedTimer timer;
+			timer.start();
+			for (qint64 i = 0; i < iterations; i++) {
+				body();
+			}
+			elapsed = timer.nsecsElapsed();
+			if (elapsed >= minTimeNs || iterations >= (qint64(1) << 40)) {
+				break;
+			}
+			iterations *= 2;
+		}
+
+		BenchmarkResult result;
+		result.name = name;
+		result.iterations = iterations;
+		result.nsPerCall = static_cast<double>(elapsed) / iterations;
+		result.pixelsPerCall = pixelsPerCall;
+		result.shapesPerCall = shapesPerCall;
+		results.push_back(result);
+
+		std::printf("%-44s %12lld  %14.1f  %10.3f  %14.0f\n", qPrintable(name), static_cast<long long>(iterations), result.nsPerCall,
+			pixelsPerCall > 0 ? result.nsPerCall / pixelsPerCall : 0.0, shapesPerCall * 1e9 / result.nsPerCall);
+		std::fflush(stdout);
+	}
+
+	// Rasterizer case: the shape is drawn into the canvas through a fresh style each call
+	void runShape(const QString& name, const std::function<void(Rasterizer&)>& draw)
+	{
+		if (!selected(name)) {
+			return;
+		}
+		double pixels = countPixels(draw);
+		run(name, pixels, 1, [&]() { draw(rasterizer); });
+	}
+
+private:
+	QImage image;
+	Rasterizer rasterizer;
+	std::vector<uchar> mask;
+	double minTimeNs;
+	QString filter;
+	std::vector<BenchmarkResult> results;
+};
+
+const QColor benchmarkBorder(20, 40, 160, 255);
+const QColor benchmarkFilling(200, 60, 30, 180);
+
+//-----------------------------------------
+//		*** Kernel cases ***
+//-----------------------------------------
+
+void benchmarkLines(BenchmarkSuite& suite)
+{
+	const QPoint center(suite.canvas().width() / 2, suite.canvas().height() / 2);
+	const int longLength = std::min(suite.canvas().width(), suite.canvas().height()) / 2 - 2;
+	struct { const char* name; int length; } lengths[] = { { "short", 8 }, { "long", longLength } };
+
+	// One direction inside each octant, plus the axis-aligned and diagonal special cases
+	struct { const char* name; double angle; } directions[] = {
+		{ "octant0", 20 }, { "octant1", 70 }, { "octant2", 110 }, { "octant3", 160 },
+		{ "octant4", 200 }, { "octant5", 250 }, { "octant6", 290 }, { "octant7", 340 },
+		{ "horizontal", 0 }, { "vertical", 90 }, { "diagonal", 45 },
+	};
+
+	for (const auto& length : lengths) {
+		for (const auto& direction : directions) {
+			double radians = direction.angle * M_PI / 180.0;
+			QPoint end = center + QPoint(qRound(length.length * std::cos(radians)), qRound(length.length * std::sin(radians)));
+			Line line(center, end, 0, false, benchmarkBorder, benchmarkFilling);
+			QVector<QPoint> points = line.getPoints();
+
+			QString name = QString("drawLineBresenham/%1/%2").arg(length.name, direction.name);
+			suite.runShape(name, [&](Rasterizer& r) {
+				r.loadShapeStyle(line);
+				r.drawLineBresenham(points);
+				});
+		}
+	}
+}
+
+QVector<QPoint> regularPolygon(const QPoint& center, int radius, int vertices)
+{
+	QVector<QPoint> points;
+	for (int i = 0; i < vertices; i++) {
+		double angle = 2.0 * M_PI * i / vertices;
+		points.append(center + QPoint(qRound(radius * std::cos(angle)), qRound(radius * std::sin(angle))));
+	}
+	return points;
+}
+
+QVector<QPoint> starPolygon(const QPoint& center, int outer, int inner, int spikes)
+{
+	QVector<QPoint> points;
+	for (int i = 0; i < 2 * spikes; i++) {
+		double angle = M_PI * i / spikes;
+		int radius = (i % 2 == 0) ? outer : inner;
+		points.append(center + QPoint(qRound(radius * std::cos(angle)), qRound(radius * std::sin(angle))));
+	}
+	return points;
+}
+
+void benchmarkPolygons(BenchmarkSuite& suite)
+{
+	const QPoint center(suite.canvas().width() / 2, suite.canvas().height() / 2);
+	const int radius = std::min(suite.canvas().width(), suite.canvas().height()) / 2 - 2;
+
+	struct { QString name; QVector<QPoint> points; } cases[] = {
+		{ "fillPolygon/convex/triangle", regularPolygon(center, radius, 3) },
+		{ "fillPolygon/convex/hexagon", regularPolygon(center, radius, 6) },
+		{ "fillPolygon/concave/star8", starPolygon(center, radius, radius / 3, 8) },
+		{ "fillPolygon/concave/star64", starPolygon(center, radius, radius / 2, 64) },
+		{ "fillPolygon/highVertex/256", regularPolygon(center, radius, 256) },
+		{ "fillPolygon/highVertex/4096", regularPolygon(center, radius, 4096) },
+	};
+
+	for (auto& polygonCase : cases) {
+		MyPolygon polygon(polygonCase.points, 0, true, benchmarkBorder, benchmarkFilling);
+		suite.runShape(polygonCase.name, [&](Rasterizer& r) {
+			r.loadShapeStyle(polygon);
+			r.fillPolygon(polygon);
+			});
+	}
+}
+
+void benchmarkCircles(BenchmarkSuite& suite)
+{
+	const QPoint center(suite.canvas().width() / 2, suite.canvas().height() / 2);
+	const int maxRadius = std::min(suite.canvas().width(), suite.canvas().height()) / 2 - 2;
+
+	for (int radius : { 4, 32, maxRadius }) {
+		for (bool filled : { false, true }) {
+			Circle circle(center, center + QPoint(radius, 0), 0, filled, benchmarkBorder, benchmarkFilling);
+			QString name = QString("drawCircle/%1/r%2").arg(filled ? "filled" : "outline").arg(radius);
+			suite.runShape(name, [&](Rasterizer& r) { r.drawCircle(circle); });
+		}
+	}
+}
+
+void benchmarkCurves(BenchmarkSuite& suite)
+{
+	const QSize size = suite.canvas().size();
+	std::mt19937 random(7);
+	std::uniform_int_distribution<int> xs(2, size.width() - 3), ys(2, size.height() - 3);
+
+	for (int controlPoints : { 3, 4, 8, 16, 32 }) {
+		QVector<QPoint> points;
+		for (int i = 0; i < controlPoints; i++) {
+			points.append(QPoint(xs(random), ys(random)));
+		}
+		BezierCurve curve(points, 0, false, benchmarkBorder, benchmarkFilling);
+		QString name = QString("drawCurve/controlPoints%1").arg(controlPoints);
+		suite.runShape(name, [&](Rasterizer& r) { r.drawCurve(curve); });
+	}
+}
+
+void benchmarkTrimming(BenchmarkSuite& suite)
+{
+	// trimPolygon clips against the canvas; the straddling cases sit just inside its right and bottom edges
+	// and reach well across them at any canvas size
+	const QSize size = suite.canvas().size();
+	const QPoint center(size.width() / 2, size.height() / 2);
+	const int extent = std::min(size.width(), size.height());
+	const int diagonal = static_cast<int>(std::hypot(size.width(), size.height()));
+
+	struct { QString name; QVector<QPoint> points; } cases[] = {
+		{ "trimPolygon/inside/hexagon", regularPolygon(center, extent * 2 / 5, 6) },
+		{ "trimPolygon/straddling/hexagon", regularPolygon(QPoint(size.width() - extent / 25, center.y()), extent * 2 / 5, 6) },
+		{ "trimPolygon/straddling/star64", starPolygon(QPoint(center.x(), size.height() - extent / 25), extent * 3 / 5, extent * 3 / 10, 64) },
+		{ "trimPolygon/covering/4096", regularPolygon(center, diagonal, 4096) },
+	};
+
+	for (auto& trimCase : cases) {
+		MyPolygon polygon(trimCase.points, 0, false, benchmarkBorder, benchmarkFilling);
+		Rasterizer& r = suite.target();
+		volatile int outputSize = 0;
+		suite.run(trimCase.name, 0, 1, [&]() { outputSize = r.trimPolygon(polygon).size(); });
+	}
+}
+
+void benchmarkTransforms(BenchmarkSuite& suite)
+{
+	// One interactive turn: compose a rotation about the center and re-derive the pixel positions
+	struct { QString name; QVector<QPoint> points; } cases[] = {
+		{ "applyTransform/rectangle", regularPolygon(QPoint(250, 250), 200, 4) },
+		{ "applyTransform/polygon/64", regularPolygon(QPoint(250, 250), 200, 64) },
+		{ "applyTransform/polygon/4096", regularPolygon(QPoint(250, 250), 200, 4096) },
+	};
+
+	for (auto& transformCase : cases) {
+		MyPolygon polygon(transformCase.points, 0, false, benchmarkBorder, benchmarkFilling);
+		QPointF center = polygon.getCenter();
+		QTransform turn = QTransform::fromTranslate(-center.x(), -center.y()) * QTransform().rotate(7) * QTransform::fromTranslate(center.x(), center.y());
+		suite.run(transformCase.name, 0, 1, [&]() { polygon.applyTransform(turn); });
+	}
+}
+
+//-----------------------------------------
+//		*** Scene cases ***
+//-----------------------------------------
+
+// Random mix of every shape type, sized so that denser scenes keep a similar total coverage
+std::vector<std::unique_ptr<Shape>> syntheticScene(const QSize& size, int count, unsigned seed)
+{
+	std::mt19937 random(seed);
+	auto uniform = [&](int low, int high) { return std::uniform_int_distribution<int>(low, high)(random); };
+	const int extent = std::max(4, static_cast<int>(std::sqrt(static_cast<double>(size.width()) * size.height() / count) * 2));
+
+	std::vector<std::unique_ptr<Shape>> shapes;
+	shapes.reserve(count);
+	for (int i = 0; i < count; i++) {
+		QPoint origin(uniform(0, size.width() - 1), uniform(0, size.height() - 1));
+		auto offset = [&]() { return origin + QPoint(uniform(-extent, extent), uniform(-extent, extent)); };
+		QColor border(uniform(0, 255), uniform(0, 255), uniform(0, 255), uniform(128, 255));
+		QColor filling(uniform(0, 255), uniform(0, 255), uniform(0, 255), uniform(128, 255));
+		bool filled = uniform(0, 1) == 1;
+
+		Shape* shape = nullptr;
+		switch (uniform(0, 4)) {
+		case 0:
+			shape = new Line(origin, offset(), i, filled, border, filling);
+			break;
+		case 1: {
+			int w = uniform(1, extent), h = uniform(1, extent);
+			shape = new MyRectangle(origin, origin + QPoint(w, 0), origin + QPoint(w, h), origin + QPoint(0, h), i, filled, border, filling);
+			break;
+		}
+		case 2: {
+			QVector<QPoint> points;
+			for (int k = uniform(3, 8); k > 0; k--) {
+				points.append(offset());
+			}
+			shape = new MyPolygon(points, i, filled, border, filling);
+			break;
+		}
+		case 3:
+			shape = new Circle(origin, origin + QPoint(uniform(0, extent / 2), 0), i, filled, border, filling);
+			break;
+		default: {
+			QVector<QPoint> points;
+			for (int k = uniform(3, 5); k > 0; k--) {
+				points.append(offset());
+			}
+			shape = new BezierCurve(points, i, false, border, filling);
+			break;
+		}
+		}
+		shape->setOpacity(uniform(0, 3) == 0 ? 0.5 : 1.0);
+		shapes.emplace_back(shape);
+	}
+	return shapes;
+}
+
+void benchmarkScenes(BenchmarkSuite& suite, int maxShapes)
+{
+	QImage& image = suite.canvas();
+	const double pixels = static_cast<double>(image.width()) * image.height();
+
+	for (int count = 100; count <= maxShapes; count *= 10) {
+		QString name = QString("redrawAllShapes/%1").arg(count);
+		QString sequentialName = name + "/sequential";
+		if (!suite.selected(name) && !suite.selected(sequentialName)) {
+			continue;
+		}
+
+		std::vector<std::unique_ptr<Shape>> scene = syntheticScene(image.size(), count, 1234u + count);
+		std::vector<Shape*> shapes;
+		for (auto& shape : scene) {
+			shapes.push_back(shape.get());
+		}
+
+		// Tiled across all cores, as ViewerWidget::redrawAllShapes does (layer cache off)
+		TileRenderer renderer;
+		suite.run(name, pixels, count, [&]() { renderer.render(image, shapes, image.rect(), qRgb(255, 255, 255)); });
+
+		TileRenderer sequential;
+		sequential.setMaxThreadCount(1);
+		suite.run(sequentialName, pixels, count, [&]() { sequential.render(image, shapes, image.rect(), qRgb(255, 255, 255)); });
+	}
+}
+
+// One frame of dragging the middle layer: a full redraw of its bounds against the manipulation mode's
+// redraw of the same area, which rasterizes only the dragged shape between the cached composites
+void benchmarkDragFrames(BenchmarkSuite& suite, int maxShapes)
+{
+	QImage& image = suite.canvas();
+
+	for (int count = 100; count <= maxShapes; count *= 10) {
+		QString name = QString("dragFrame/%1").arg(count);
+		if (!suite.selected(name)) {
+			continue;
+		}
+
+		std::vector<std::unique_ptr<Shape>> scene = syntheticScene(image.size(), count, 4321u + count);
+		const size_t moving = scene.size() / 2;
+		QRect area = scene[moving]->getBoundingRect().adjusted(-1, -1, 1, 1).intersected(image.rect());
+		std::vector<Shape*> below, above, visible;
+		for (size_t i = 0; i < scene.size(); i++) {
+			if (i < moving) {
+				below.push_back(scene[i].get());
+			}
+			else if (i > moving) {
+				above.push_back(scene[i].get());
+			}
+			// The viewer culls through its spatial index before redrawing
+			if (scene[i]->getBoundingRect().adjusted(-1, -1, 1, 1).intersects(area)) {
+				visible.push_back(scene[i].get());
+			}
+		}
+		std::vector<Shape*> dragged(1, scene[moving].get());
+		const double pixels = static_cast<double>(area.width()) * area.height();
+
+		TileRenderer renderer;
+		suite.run(name + "/full", pixels, static_cast<double>(visible.size()), [&]() { renderer.render(image, visible, area, qRgb(255, 255, 255)); });
+
+		QImage belowLayers(image.size(), QImage::Format_ARGB32_Premultiplied);
+		QImage aboveLayers(image.size(), QImage::Format_ARGB32_Premultiplied);
+		renderer.render(belowLayers, below, belowLayers.rect(), qRgb(255, 255, 255));
+		renderer.render(aboveLayers, above, aboveLayers.rect(), 0);
+		suite.run(name + "/composited", pixels, 1, [&]() { renderer.renderBetween(image, dragged, area, belowLayers, aboveLayers); });
+	}
+}
+
+void benchmarkSpatialIndex(BenchmarkSuite& suite, int maxShapes)
+{
+	QImage& image = suite.canvas();
+
+	for (int count = 1000; count <= maxShapes; count *= 10) {
+		QString prefix = QString("spatialIndex/%1/").arg(count);
+		if (!suite.selected(prefix + "query") && !suite.selected(prefix + "hitsAt") && !suite.selected(prefix + "update")) {
+			continue;
+		}
+
+		std::vector<std::unique_ptr<Shape>> scene = syntheticScene(image.size(), count, 4321u + count);
+		SpatialIndex index;
+		for (auto& shape : scene) {
+			index.insert(shape.get());
+		}
+
+		// A 64x64 dirty rectangle and a click, both sweeping the canvas between calls
+		std::vector<Shape*> result;
+		int step = 0;
+		suite.run(prefix + "query", 0, 1, [&]() {
+			step = (step + 97) % (image.width() * image.height());
+			index.query(QRect(step % image.width(), step / image.width(), 64, 64), result);
+			});
+		suite.run(prefix + "hitsAt", 0, 1, [&]() {
+			step = (step + 97) % (image.width() * image.height());
+			index.hitsAt(QPoint(step % image.width(), step / image.width()), 3, result);
+			});
+
+		// Nudging one shape back and forth, as a drag does
+		Shape* moved = scene[count / 2].get();
+		QVector<QPoint> points = moved->getPoints();
+		int direction = 1;
+		suite.run(prefix + "update", 0, 1, [&]() {
+			for (QPoint& point : points) {
+				point += QPoint(5 * direction, 0);
+			}
+			direction = -direction;
+			moved->setPoints(points);
+			index.update(moved);
+			});
+	}
+}
+
+void benchmarkLayerStack(BenchmarkSuite& suite, int maxShapes)
+{
+	QImage& image = suite.canvas();
+
+	for (int count = 1000; count <= maxShapes; count *= 10) {
+		QString prefix = QString("layerStack/%1/").arg(count);
+		if (!suite.selected(prefix + "insertBulk") && !suite.selected(prefix + "swapAdjacent") && !suite.selected(prefix + "positionOf")) {
+			continue;
+		}
+
+		// Depths in random order, as a CSV scene saved after restacking would list them
+		std::vector<std::unique_ptr<Shape>> scene = syntheticScene(image.size(), count, 2468u + count);
+		std::vector<std::pair<Shape*, int>> entries;
+		std::mt19937 random(count);
+		for (auto& shape : scene) {
+			entries.push_back({ shape.get(), std::uniform_int_distribution<int>(0, count)(random) });
+		}
+
+		suite.run(prefix + "insertBulk", 0, count, [&]() {
+			LayerStack layers;
+			layers.insertBulk(entries);
+			});
+
+		LayerStack layers;
+		layers.insertBulk(entries);
+		int step = 0;
+		suite.run(prefix + "swapAdjacent", 0, 1, [&]() {
+			step = (step + 7919) % (count - 1);
+			layers.swapAdjacent(step);
+			});
+		volatile int position = 0;
+		suite.run(prefix + "positionOf", 0, 1, [&]() {
+			step = (step + 7919) % count;
+			position = layers.positionOf(entries[step].first);
+			});
+	}
+}
+
+//-----------------------------------------
+//		*** Output ***
+//-----------------------------------------
+
+bool writeJson(const QString& path, const QSize& canvasSize, const std::vector<BenchmarkResult>& results)
+{
+	QFile file(path);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+		return false;
+	}
+
+	QTextStream out(&file);
+	out << "{\n";
+	out << "  \"canvas\": { \"width\": " << canvasSize.width() << ", \"height\": " << canvasSize.height() << " },\n";
+	out << "  \"threads\": " << QThread::idealThreadCount() << ",\n";
+	out << "  \"results\": [\n";
+	for (size_t i = 0; i < results.size(); i++) {
+		const BenchmarkResult& result = results[i];
+		out << "    { \"name\": \"" << result.name << "\""
+			<< ", \"iterations\": " << result.iterations
+			<< ", \"ns_per_call\": " << QString::number(result.nsPerCall, 'f', 3)
+			<< ", \"pixels_per_call\": " << QString::number(result.pixelsPerCall, 'f', 0)
+			<< ", \"ns_per_pixel\": " << QString::number(result.pixelsPerCall > 0 ? result.nsPerCall / result.pixelsPerCall : 0.0, 'f', 6)
+			<< ", \"shapes_per_second\": " << QString::number(result.shapesPerCall * 1e9 / result.nsPerCall, 'f', 1)
+			<< " }" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	out << "  ]\n";
+	out << "}\n";
+	return true;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+	QLocale::setDefault(QLocale::c());
+
+	QCoreApplication app(argc, argv);
+	QCoreApplication::setApplicationName("ImageViewer benchmarks");
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Microbenchmarks for the ImageViewer rasterization kernels.");
+	parser.addHelpOption();
+	QCommandLineOption filterOption("filter", "Only run cases whose name contains text.", "text");
+	QCommandLineOption minTimeOption("min-time", "Minimum measured time per case in ms (default: 200).", "ms", "200");
+	QCommandLineOption maxShapesOption("max-shapes", "Largest synthetic scene for redrawAllShapes (default: 1000000).", "n", "1000000");
+	QCommandLineOption sizeOption("size", "Canvas size (default: 1000x1000).", "WxH", "1000x1000");
+	QCommandLineOption jsonOption("json", "Machine-readable results (default: benchmark_results.json).", "file", "benchmark_results.json");
+	parser.addOption(filterOption);
+	parser.addOption(minTimeOption);
+	parser.addOption(maxShapesOption);
+	parser.addOption(sizeOption);
+	parser.addOption(jsonOption);
+	parser.process(app);
+
+	QStringList size = parser.value(sizeOption).split('x');
+	if (size.size() != 2 || size[0].toInt() <= 0 || size[1].toInt() <= 0) {
+		std::fprintf(stderr, "Invalid canvas size: %s\n", qPrintable(parser.value(sizeOption)));
+		return 2;
+	}
+	QSize canvasSize(size[0].toInt(), size[1].toInt());
+
+	BenchmarkSuite suite(canvasSize, parser.value(minTimeOption).toDouble(), parser.value(filterOption));
+
+	std::printf("%-44s %12s  %14s  %10s  %14s\n", "case", "iterations", "ns/call", "ns/pixel", "shapes/s");
+	benchmarkLines(suite);
+	benchmarkPolygons(suite);
+	benchmarkCircles(suite);
+	benchmarkCurves(suite);
+	benchmarkTrimming(suite);
+	benchmarkTransforms(suite);
+	benchmarkScenes(suite, parser.value(maxShapesOption).toInt());
+	benchmarkDragFrames(suite, parser.value(maxShapesOption).toInt());
+	benchmarkSpatialIndex(suite, parser.value(maxShapesOption).toInt());
+	benchmarkLayerStack(suite, parser.value(maxShapesOption).toInt());
+
+	QString jsonPath = parser.value(jsonOption);
+	if (!writeJson(jsonPath, canvasSize, suite.getResults())) {
+		std::fprintf(stderr, "Unable to write %s\n", qPrintable(jsonPath));
+		return 1;
+	}
+	std::printf("Results written to %s\n", qPrintable(jsonPath));
+	return 0;
+}
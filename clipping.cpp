@@ -0,0 +1,83 @@
+#include "clipping.h"
+#include <algorithm>
+
+namespace {
+
+// One side of the clip rectangle: points with coordinate on the kept side of value survive
+struct ClipBoundary {
+	bool vertical;	// Compares x when true, y otherwise
+	double value;
+	bool keepGreater;
+
+	bool inside(const QPointF& point) const
+	{
+		double coordinate = vertical ? point.x() : point.y();
+		return keepGreater ? coordinate >= value : coordinate <= value;
+	}
+
+	QPointF intersect(const QPointF& from, const QPointF& to) const
+	{
+		if (vertical) {
+			double t = (value - from.x()) / (to.x() - from.x());
+			return QPointF(value, from.y() + t * (to.y() - from.y()));
+		}
+		double t = (value - from.y()) / (to.y() - from.y());
+		return QPointF(from.x() + t * (to.x() - from.x()), value);
+	}
+};
+
+void clipPass(const std::vector<QPointF>& input, std::vector<QPointF>& output, const ClipBoundary& boundary)
+{
+	output.clear();
+	if (input.empty()) {
+		return;
+	}
+
+	QPointF previous = input.back();
+	bool previousInside = boundary.inside(previous);
+	for (const QPointF& current : input) {
+		bool currentInside = boundary.inside(current);
+		if (currentInside != previousInside) {
+			output.push_back(boundary.intersect(previous, current));
+		}
+		if (currentInside) {
+			output.push_back(current);
+		}
+		previous = current;
+		previousInside = currentInside;
+	}
+}
+
+}
+
+int clipPolygonToRect(const QPoint* points, int count, const QRectF& clip, std::vector<QPointF>& output, std::vector<QPointF>& scratch)
+{
+	output.clear();
+	if (count <= 0) {
+		return 0;
+	}
+
+	int left = points[0].x(), right = left, top = points[0].y(), bottom = top;
+	for (int i = 1; i < count; i++) {
+		left = std::min(left, points[i].x());
+		right = std::max(right, points[i].x());
+		top = std::min(top, points[i].y());
+		bottom = std::max(bottom, points[i].y());
+	}
+
+	if (right < clip.left() || left > clip.right() || bottom < clip.top() || top > clip.bottom()) {
+		return 0;
+	}
+
+	output.assign(points, points + count);
+	if (left >= clip.left() && right <= clip.right() && top >= clip.top() && bottom <= clip.bottom()) {
+		return count;
+	}
+
+	// The passes alternate between the two buffers and end in output
+	clipPass(output, scratch, { true, clip.left(), true });
+	clipPass(scratch, output, { false, clip.top(), true });
+	clipPass(output, scratch, { true, clip.right(), false });
+	clipPass(scratch, output, { false, clip.bottom(), false });
+	return static_cast<int>(output.size());
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include <QPoint>
+#include <QPointF>
+#include <QRectF>
+#include <vector>
+
+// Sutherland-Hodgman clip of a closed polygon against the rectangle [clip.left(), clip.right()] x
+// [clip.top(), clip.bottom()], borders included, in double precision. The result goes to output and
+// scratch carries the passes in between; both belong to the caller, so repeated clips reuse their
+// storage. Polygons whose bounds lie fully inside are copied and those fully outside are dropped
+// without running the passes. Returns the number of points written to output.
+int clipPolygonToRect(const QPoint* points, int count, const QRectF& clip, std::vector<QPointF>& output, std::vector<QPointF>& scratch);
@@ -0,0 +1,303 @@
+#include "compositing.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define COMPOSITING_SSE2
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define COMPOSITING_AVX2
+#endif
+
+//-----------------------------------------
+//		*** Scalar kernels ***
+//-----------------------------------------
+
+// Rounded x / 255, exact for x in [0, 255 * 255]
+static inline int div255(int x)
+{
+	x += 128;
+	return (x + (x >> 8)) >> 8;
+}
+
+// One premultiplied channel of the separable blend modes; the same formula also yields the result alpha
+template<int Mode>
+static inline int blendChannel(int s, int sa, int d, int da)
+{
+	switch (Mode) {
+	case Shape::SOURCE_OVER:
+		return s + div255(d * (255 - sa));
+	case Shape::MULTIPLY:
+		return div255(s * (255 - da)) + div255(d * (255 - sa)) + div255(s * d);
+	case Shape::SCREEN:
+		return s + d - div255(s * d);
+	case Shape::OVERLAY: {
+		int b = (2 * d <= da) ? 2 * div255(s * d) : div255(sa * da) - 2 * div255((da - d) * (sa - s));
+		return div255(s * (255 - da)) + div255(d * (255 - sa)) + b;
+	}
+	default:
+		return s + d;
+	}
+}
+
+template<int Mode>
+static inline QRgb blendScalar(QRgb src, QRgb dst)
+{
+	int sa = qAlpha(src);
+	int da = qAlpha(dst);
+
+	int a = qBound(0, blendChannel<Mode>(sa, sa, da, da), 255);
+	int r = qBound(0, blendChannel<Mode>(qRed(src), sa, qRed(dst), da), 255);
+	int g = qBound(0, blendChannel<Mode>(qGreen(src), sa, qGreen(dst), da), 255);
+	int b = qBound(0, blendChannel<Mode>(qBlue(src), sa, qBlue(dst), da), 255);
+
+	return qRgba(r, g, b, a);
+}
+
+//-----------------------------------------
+//		*** Vector kernels ***
+//-----------------------------------------
+// Pixels are widened to 16 bits per channel, so every product of two channels fits a lane.
+// Sse2 handles 4 pixels per step, Avx2 handles 8; both share blendLanes() below.
+
+#ifdef COMPOSITING_SSE2
+struct Sse2 {
+	typedef __m128i Vec;
+	enum { Pixels = 4 };
+
+	static Vec load(const QRgb* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+	static void store(QRgb* p, Vec v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+	static Vec broadcast(QRgb c) { return _mm_set1_epi32(static_cast<int>(c)); }
+	static Vec constant(short v) { return _mm_set1_epi16(v); }
+	static Vec unpackLo(Vec v) { return _mm_unpacklo_epi8(v, _mm_setzero_si128()); }
+	static Vec unpackHi(Vec v) { return _mm_unpackhi_epi8(v, _mm_setzero_si128()); }
+	static Vec pack(Vec lo, Vec hi) { return _mm_packus_epi16(lo, hi); }
+	static Vec add(Vec a, Vec b) { return _mm_add_epi16(a, b); }
+	static Vec sub(Vec a, Vec b) { return _mm_sub_epi16(a, b); }
+	static Vec mul(Vec a, Vec b) { return _mm_mullo_epi16(a, b); }
+	static Vec shr8(Vec a) { return _mm_srli_epi16(a, 8); }
+	static Vec greater(Vec a, Vec b) { return _mm_cmpgt_epi16(a, b); }
+	static Vec select(Vec mask, Vec a, Vec b) { return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b)); }
+	static Vec alpha(Vec v) { return _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3)); }
+};
+#endif
+
+#ifdef COMPOSITING_AVX2
+struct Avx2 {
+	typedef __m256i Vec;
+	enum { Pixels = 8 };
+
+	static Vec load(const QRgb* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+	static void store(QRgb* p, Vec v) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+	static Vec broadcast(QRgb c) { return _mm256_set1_epi32(static_cast<int>(c)); }
+	static Vec constant(short v) { return _mm256_set1_epi16(v); }
+	static Vec unpackLo(Vec v) { return _mm256_unpacklo_epi8(v, _mm256_setzero_si256()); }
+	static Vec unpackHi(Vec v) { return _mm256_unpackhi_epi8(v, _mm256_setzero_si256()); }
+	static Vec pack(Vec lo, Vec hi) { return _mm256_packus_epi16(lo, hi); }
+	static Vec add(Vec a, Vec b) { return _mm256_add_epi16(a, b); }
+	static Vec sub(Vec a, Vec b) { return _mm256_sub_epi16(a, b); }
+	static Vec mul(Vec a, Vec b) { return _mm256_mullo_epi16(a, b); }
+	static Vec shr8(Vec a) { return _mm256_srli_epi16(a, 8); }
+	static Vec greater(Vec a, Vec b) { return _mm256_cmpgt_epi16(a, b); }
+	static Vec select(Vec mask, Vec a, Vec b) { return _mm256_blendv_epi8(b, a, mask); }
+	static Vec alpha(Vec v) { return _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(v, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3)); }
+};
+#endif
+
+#if defined(COMPOSITING_SSE2) || defined(COMPOSITING_AVX2)
+template<class Ops>
+static inline typename Ops::Vec div255(typename Ops::Vec x)
+{
+	x = Ops::add(x, Ops::constant(128));
+	return Ops::shr8(Ops::add(x, Ops::shr8(x)));
+}
+
+// Vector form of blendChannel(); packing afterwards saturates the lanes back to 0..255
+template<class Ops, int Mode>
+static inline typename Ops::Vec blendLanes(typename Ops::Vec s, typename Ops::Vec sa, typename Ops::Vec d)
+{
+	typedef typename Ops::Vec Vec;
+	const Vec full = Ops::constant(255);
+	const Vec invSa = Ops::sub(full, sa);
+
+	switch (Mode) {
+	case Shape::SOURCE_OVER:
+		return Ops::add(s, div255<Ops>(Ops::mul(d, invSa)));
+	case Shape::MULTIPLY: {
+		Vec da = Ops::alpha(d);
+		Vec outside = Ops::add(div255<Ops>(Ops::mul(s, Ops::sub(full, da))), div255<Ops>(Ops::mul(d, invSa)));
+		return Ops::add(outside, div255<Ops>(Ops::mul(s, d)));
+	}
+	case Shape::SCREEN:
+		return Ops::sub(Ops::add(s, d), div255<Ops>(Ops::mul(s, d)));
+	case Shape::OVERLAY: {
+		Vec da = Ops::alpha(d);
+		Vec product = div255<Ops>(Ops::mul(s, d));
+		Vec lower = Ops::add(product, product);
+		Vec inverse = div255<Ops>(Ops::mul(Ops::sub(da, d), Ops::sub(sa, s)));
+		Vec upper = Ops::sub(div255<Ops>(Ops::mul(sa, da)), Ops::add(inverse, inverse));
+		Vec inner = Ops::select(Ops::greater(Ops::add(d, d), da), upper, lower);
+		Vec outside = Ops::add(div255<Ops>(Ops::mul(s, Ops::sub(full, da))), div255<Ops>(Ops::mul(d, invSa)));
+		return Ops::add(outside, inner);
+	}
+	default:
+		return Ops::add(s, d);
+	}
+}
+
+// Blends as many whole vectors as fit in count and returns the number of pixels processed
+template<class Ops, int Mode>
+static int blendRun(QRgb* dst, int count, QRgb src)
+{
+	typedef typename Ops::Vec Vec;
+	const Vec s = Ops::unpackLo(Ops::broadcast(src));
+	const Vec sa = Ops::alpha(s);
+
+	int i = 0;
+	for (; i + Ops::Pixels <= count; i += Ops::Pixels) {
+		Vec d = Ops::load(dst + i);
+		Vec lo = blendLanes<Ops, Mode>(s, sa, Ops::unpackLo(d));
+		Vec hi = blendLanes<Ops, Mode>(s, sa, Ops::unpackHi(d));
+		Ops::store(dst + i, Ops::pack(lo, hi));
+	}
+	return i;
+}
+
+// Source-over with a separate source pixel per lane
+template<class Ops>
+static int compositeRun(QRgb* dst, const QRgb* src, int count)
+{
+	typedef typename Ops::Vec Vec;
+	int i = 0;
+	for (; i + Ops::Pixels <= count; i += Ops::Pixels) {
+		Vec s = Ops::load(src + i);
+		Vec d = Ops::load(dst + i);
+		Vec sLo = Ops::unpackLo(s);
+		Vec sHi = Ops::unpackHi(s);
+		Vec lo = blendLanes<Ops, Shape::SOURCE_OVER>(sLo, Ops::alpha(sLo), Ops::unpackLo(d));
+		Vec hi = blendLanes<Ops, Shape::SOURCE_OVER>(sHi, Ops::alpha(sHi), Ops::unpackHi(d));
+		Ops::store(dst + i, Ops::pack(lo, hi));
+	}
+	return i;
+}
+#endif
+
+template<int Mode>
+static void blendSpanMode(QRgb* dst, int count, QRgb src)
+{
+	int done = 0;
+#ifdef COMPOSITING_AVX2
+	done += blendRun<Avx2, Mode>(dst + done, count - done, src);
+#endif
+#ifdef COMPOSITING_SSE2
+	done += blendRun<Sse2, Mode>(dst + done, count - done, src);
+#endif
+	for (; done < count; done++) {
+		dst[done] = blendScalar<Mode>(src, dst[done]);
+	}
+}
+
+// Opaque source-over is a plain copy, written four pixels per store once dst is 16-byte aligned
+static void fillPixels(QRgb* dst, int count, QRgb color)
+{
+#ifdef COMPOSITING_SSE2
+	while (count > 0 && (reinterpret_cast<quintptr>(dst) & 15)) {
+		*dst++ = color;
+		count--;
+	}
+
+	const __m128i packed = _mm_set1_epi32(static_cast<int>(color));
+	for (; count >= 16; count -= 16, dst += 16) {
+		_mm_store_si128(reinterpret_cast<__m128i*>(dst), packed);
+		_mm_store_si128(reinterpret_cast<__m128i*>(dst + 4), packed);
+		_mm_store_si128(reinterpret_cast<__m128i*>(dst + 8), packed);
+		_mm_store_si128(reinterpret_cast<__m128i*>(dst + 12), packed);
+	}
+	for (; count >= 4; count -= 4, dst += 4) {
+		_mm_store_si128(reinterpret_cast<__m128i*>(dst), packed);
+	}
+#endif
+	while (count-- > 0) {
+		*dst++ = color;
+	}
+}
+
+//-----------------------------------------
+//		*** Public functions ***
+//-----------------------------------------
+
+QRgb premultiplyColor(const QColor& color, double opacity)
+{
+	int alpha = qRound(color.alpha() * qBound(0.0, opacity, 1.0));
+	return qPremultiply(qRgba(color.red(), color.green(), color.blue(), alpha));
+}
+
+void blendPixel(QRgb* dst, QRgb src, Shape::BlendMode mode)
+{
+	switch (mode) {
+	case Shape::SOURCE_OVER:
+		if (qAlpha(src) == 255) {
+			*dst = src;
+		}
+		else if (qAlpha(src) != 0) {
+			*dst = blendScalar<Shape::SOURCE_OVER>(src, *dst);
+		}
+		break;
+	case Shape::MULTIPLY:
+		*dst = blendScalar<Shape::MULTIPLY>(src, *dst);
+		break;
+	case Shape::SCREEN:
+		*dst = blendScalar<Shape::SCREEN>(src, *dst);
+		break;
+	case Shape::OVERLAY:
+		*dst = blendScalar<Shape::OVERLAY>(src, *dst);
+		break;
+	case Shape::ADDITIVE:
+		*dst = blendScalar<Shape::ADDITIVE>(src, *dst);
+		break;
+	}
+}
+
+void blendSolidSpan(QRgb* dst, int count, QRgb src, Shape::BlendMode mode)
+{
+	if (count <= 0) {
+		return;
+	}
+
+	switch (mode) {
+	case Shape::SOURCE_OVER:
+		if (qAlpha(src) == 255) {
+			fillPixels(dst, count, src);
+		}
+		else if (qAlpha(src) != 0) {
+			blendSpanMode<Shape::SOURCE_OVER>(dst, count, src);
+		}
+		break;
+	case Shape::MULTIPLY:
+		blendSpanMode<Shape::MULTIPLY>(dst, count, src);
+		break;
+	case Shape::SCREEN:
+		blendSpanMode<Shape::SCREEN>(dst, count, src);
+		break;
+	case Shape::OVERLAY:
+		blendSpanMode<Shape::OVERLAY>(dst, count, src);
+		break;
+	case Shape::ADDITIVE:
+		blendSpanMode<Shape::ADDITIVE>(dst, count, src);
+		break;
+	}
+}
+
+void compositeSpan(QRgb* dst, const QRgb* src, int count)
+{
+	int done = 0;
+#ifdef COMPOSITING_AVX2
+	done += compositeRun<Avx2>(dst + done, src + done, count - done);
+#endif
+#ifdef COMPOSITING_SSE2
+	done += compositeRun<Sse2>(dst + done, src + done, count - done);
+#endif
+	for (; done < count; done++) {
+		blendPixel(dst + done, src[done], Shape::SOURCE_OVER);
+	}
+}
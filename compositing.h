@@ -0,0 +1,20 @@
+#pragma once
+#include <QColor>
+#include "representation.h"
+
+//-----------------------------------------
+//		*** Compositing ***
+//-----------------------------------------
+// All colors handled here are premultiplied ARGB32 (QImage::Format_ARGB32_Premultiplied).
+
+// Converts a straight-alpha color to premultiplied ARGB32, scaling its alpha by the layer opacity
+QRgb premultiplyColor(const QColor& color, double opacity = 1.0);
+
+// Composites src onto a single destination pixel
+void blendPixel(QRgb* dst, QRgb src, Shape::BlendMode mode);
+
+// Composites a constant src color onto count consecutive destination pixels
+void blendSolidSpan(QRgb* dst, int count, QRgb src, Shape::BlendMode mode);
+
+// Composites count src pixels onto as many destination pixels with source-over
+void compositeSpan(QRgb* dst, const QRgb* src, int count);
@@ -0,0 +1,284 @@
+#include "instrumentation.h"
+
+#ifdef IMAGEVIEWER_INSTRUMENTATION
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QTextStream>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <map>
+#include <unordered_map>
+
+namespace Instrumentation {
+
+namespace {
+
+struct TraceEvent {
+	const char* name;
+	qint64 startNs;
+	qint64 durationNs;
+};
+
+struct ThreadLog {
+	int threadId;
+	// Written only by the owning thread, so plain loads and stores suffice
+	std::atomic<qint64> counters[CounterCount];
+	// Guards timers and events, which other threads read when reporting
+	QMutex mutex;
+	std::unordered_map<const char*, TimerStats> timers;
+	std::vector<TraceEvent> events;
+
+	ThreadLog();
+	~ThreadLog();
+};
+
+struct Registry {
+	QMutex mutex;
+	QElapsedTimer clock;
+	std::atomic<bool> tracing{ false };
+	int nextThreadId = 1;
+	std::vector<ThreadLog*> threads;
+
+	// Totals left behind by threads that have exited
+	qint64 counters[CounterCount] = {};
+	std::map<QString, TimerStats> timers;
+	std::vector<std::pair<int, TraceEvent>> events;
+
+	Registry() { clock.start(); }
+};
+
+Registry& registry()
+{
+	static Registry instance;
+	return instance;
+}
+
+ThreadLog& currentThreadLog()
+{
+	thread_local ThreadLog log;
+	return log;
+}
+
+void mergeStats(TimerStats& into, const TimerStats& from)
+{
+	into.calls += from.calls;
+	into.totalNs += from.totalNs;
+	into.maxNs = qMax(into.maxNs, from.maxNs);
+}
+
+ThreadLog::ThreadLog()
+{
+	for (std::atomic<qint64>& counter : counters) {
+		counter.store(0, std::memory_order_relaxed);
+	}
+
+	Registry& r = registry();
+	QMutexLocker locker(&r.mutex);
+	threadId = r.nextThreadId++;
+	r.threads.push_back(this);
+}
+
+ThreadLog::~ThreadLog()
+{
+	Registry& r = registry();
+	QMutexLocker locker(&r.mutex);
+	for (int i = 0; i < CounterCount; i++) {
+		r.counters[i] += counters[i].load(std::memory_order_relaxed);
+	}
+	for (const auto& timer : timers) {
+		mergeStats(r.timers[QString(timer.first)], timer.second);
+	}
+	for (const TraceEvent& event : events) {
+		r.events.push_back({ threadId, event });
+	}
+	r.threads.erase(std::find(r.threads.begin(), r.threads.end(), this));
+}
+
+}
+
+//-----------------------------------------
+//		*** Counters and timers ***
+//-----------------------------------------
+
+void addToCounter(Counter counter, qint64 amount)
+{
+	std::atomic<qint64>& value = currentThreadLog().counters[counter];
+	value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+qint64 counterValue(Counter counter)
+{
+	Registry& r = registry();
+	QMutexLocker locker(&r.mutex);
+	qint64 total = r.counters[counter];
+	for (ThreadLog* log : r.threads) {
+		total += log->counters[counter].load(std::memory_order_relaxed);
+	}
+	return total;
+}
+
+std::vector<std::pair<QString, TimerStats>> timerStats()
+{
+	Registry& r = registry();
+	QMutexLocker locker(&r.mutex);
+	std::map<QString, TimerStats> merged = r.timers;
+	for (ThreadLog* log : r.threads) {
+		QMutexLocker logLocker(&log->mutex);
+		for (const auto& timer : log->timers) {
+			mergeStats(merged[QString(timer.first)], timer.second);
+		}
+	}
+	return std::vector<std::pair<QString, TimerStats>>(merged.begin(), merged.end());
+}
+
+void reset()
+{
+	Registry& r = registry();
+	QMutexLocker locker(&r.mutex);
+	for (qint64& counter : r.counters) {
+		counter = 0;
+	}
+	r.timers.clear();
+	r.events.clear();
+	for (ThreadLog* log : r.threads) {
+		for (std::atomic<qint64>& counter : log->counters) {
+			counter.store(0, std::memory_order_relaxed);
+		}
+		QMutexLocker logLocker(&log->mutex);
+		log->timers.clear();
+		log->events.clear();
+	}
+}
+
+ScopedTimer::ScopedTimer(const char* name)
+	: name(name), startNs(registry().clock.nsecsElapsed())
+{
+}
+
+ScopedTimer::~ScopedTimer()
+{
+	Registry& r = registry();
+	qint64 durationNs = r.clock.nsecsElapsed() - startNs;
+
+	ThreadLog& log = currentThreadLog();
+	QMutexLocker locker(&log.mutex);
+	TimerStats& stats = log.timers[name];
+	stats.calls++;
+	stats.totalNs += durationNs;
+	stats.maxNs = qMax(stats.maxNs, durationNs);
+	if (r.tracing.load(std::memory_order_relaxed)) {
+		log.events.push_back({ name, startNs, durationNs });
+	}
+}
+
+//-----------------------------------------
+//		*** Reporting ***
+//-----------------------------------------
+
+void setTracing(bool enabled)
+{
+	registry().tracing.store(enabled);
+}
+
+bool isTracing()
+{
+	return registry().tracing.load();
+}
+
+bool writeChromeTrace(const QString& path)
+{
+	Registry& r = registry();
+	QMutexLocker locker(&r.mutex);
+
+	std::vector<std::pair<int, TraceEvent>> events = r.events;
+	std::vector<int> threadIds;
+	for (const auto& event : events) {
+		if (std::find(threadIds.begin(), threadIds.end(), event.first) == threadIds.end()) {
+			threadIds.push_back(event.first);
+		}
+	}
+	qint64 counters[CounterCount];
+	for (int i = 0; i < CounterCount; i++) {
+		counters[i] = r.counters[i];
+	}
+	for (ThreadLog* log : r.threads) {
+		QMutexLocker logLocker(&log->mutex);
+		for (const TraceEvent& event : log->events) {
+			events.push_back({ log->threadId, event });
+		}
+		threadIds.push_back(log->threadId);
+		for (int i = 0; i < CounterCount; i++) {
+			counters[i] += log->counters[i].load(std::memory_order_relaxed);
+		}
+	}
+	qint64 endNs = r.clock.nsecsElapsed();
+	locker.unlock();
+
+	QFile file(path);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		return false;
+	}
+
+	// Complete ("X") events in microseconds, one track per thread, and the counters at the end of the trace
+	QTextStream out(&file);
+	out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+	for (int threadId : threadIds) {
+		out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << threadId
+			<< ",\"args\":{\"name\":\"thread " << threadId << "\"}},\n";
+	}
+	for (const auto& event : events) {
+		out << "{\"name\":\"" << event.second.name << "\",\"cat\":\"render\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.first
+			<< ",\"ts\":" << QString::number(event.second.startNs / 1000.0, 'f', 3)
+			<< ",\"dur\":" << QString::number(event.second.durationNs / 1000.0, 'f', 3) << "},\n";
+	}
+	out << "{\"name\":\"counters\",\"ph\":\"C\",\"pid\":1,\"tid\":1,\"ts\":" << QString::number(endNs / 1000.0, 'f', 3)
+		<< ",\"args\":{\"pixelsWritten\":" << counters[PixelsWritten]
+		<< ",\"shapesRasterized\":" << counters[ShapesRasterized]
+		<< ",\"redraws\":" << counters[Redraws] << "}}\n]}\n";
+	out.flush();
+
+	return file.error() == QFileDevice::NoError;
+}
+
+QString summary()
+{
+	QString text = QString("pixels written %1, shapes rasterized %2, redraws %3\n")
+		.arg(counterValue(PixelsWritten))
+		.arg(counterValue(ShapesRasterized))
+		.arg(counterValue(Redraws));
+
+	text += QString("%1 %2 %3 %4 %5\n").arg("scope", -36).arg("calls", 10).arg("total ms", 12).arg("mean us", 12).arg("max us", 12);
+	for (const auto& timer : timerStats()) {
+		const TimerStats& stats = timer.second;
+		text += QString("%1 %2 %3 %4 %5\n")
+			.arg(timer.first, -36)
+			.arg(stats.calls, 10)
+			.arg(stats.totalNs / 1e6, 12, 'f', 3)
+			.arg(stats.totalNs / 1e3 / qMax<qint64>(stats.calls, 1), 12, 'f', 3)
+			.arg(stats.maxNs / 1e3, 12, 'f', 3);
+	}
+	return text;
+}
+
+Session::Session(const QString& tracePath)
+	: tracePath(tracePath)
+{
+	if (!tracePath.isEmpty()) {
+		setTracing(true);
+	}
+}
+
+Session::~Session()
+{
+	if (!tracePath.isEmpty() && !writeChromeTrace(tracePath)) {
+		std::fprintf(stderr, "Unable to write trace: %s\n", qPrintable(tracePath));
+	}
+	std::fprintf(stderr, "%s", qPrintable(summary()));
+}
+
+}
+
+#endif
@@ -0,0 +1,83 @@
+#pragma once
+// Profiling hooks for the render paths. Builds without IMAGEVIEWER_INSTRUMENTATION defined expand every
+// macro below to nothing, so the hooks cost nothing in a normal build.
+//
+//	INSTRUMENT_SCOPE("Rasterizer::fillPolygon");	times the enclosing block
+//	INSTRUMENT_COUNT(PixelsWritten, count);			adds to one of the Instrumentation::Counter values
+//	INSTRUMENT_SESSION(path);						reports on exit and, for a non-empty path, writes a Chrome trace
+//
+// Scopes and counters are recorded per thread, so tile workers never contend with each other.
+// The trace opens in chrome://tracing or https://ui.perfetto.dev.
+
+#ifdef IMAGEVIEWER_INSTRUMENTATION
+
+#include <QString>
+#include <utility>
+#include <vector>
+
+namespace Instrumentation {
+
+enum Counter {
+	PixelsWritten,
+	ShapesRasterized,
+	Redraws,
+	CounterCount
+};
+
+struct TimerStats {
+	qint64 calls = 0;
+	qint64 totalNs = 0;
+	qint64 maxNs = 0;
+};
+
+void addToCounter(Counter counter, qint64 amount);
+qint64 counterValue(Counter counter);
+
+// Per scope totals over all threads, sorted by name
+std::vector<std::pair<QString, TimerStats>> timerStats();
+
+// Clears counters, scope totals and recorded trace events
+void reset();
+
+// Trace events are only recorded while tracing is on; scope totals and counters always are
+void setTracing(bool enabled);
+bool isTracing();
+bool writeChromeTrace(const QString& path);
+
+// Counters and scope totals as a text table
+QString summary();
+
+class ScopedTimer {
+public:
+	explicit ScopedTimer(const char* name);
+	~ScopedTimer();
+
+private:
+	const char* name;
+	qint64 startNs;
+};
+
+class Session {
+public:
+	explicit Session(const QString& tracePath);
+	~Session();
+
+private:
+	QString tracePath;
+};
+
+}
+
+#define INSTRUMENT_CONCAT_(a, b) a##b
+#define INSTRUMENT_CONCAT(a, b) INSTRUMENT_CONCAT_(a, b)
+#define INSTRUMENT_SCOPE(name) Instrumentation::ScopedTimer INSTRUMENT_CONCAT(instrumentScope, __LINE__)(name)
+#define INSTRUMENT_COUNT(counter, amount) Instrumentation::addToCounter(Instrumentation::counter, (amount))
+#define INSTRUMENT_SESSION(tracePath) Instrumentation::Session instrumentSession(tracePath)
+
+#else
+
+#define INSTRUMENT_SCOPE(name) do {} while (false)
+#define INSTRUMENT_COUNT(counter, amount) do {} while (false)
+#define INSTRUMENT_SESSION(tracePath) do {} while (false)
+
+#endif
@@ -0,0 +1,200 @@
+#include "layercache.h"
+#include "rasterizer.h"
+#include "instrumentation.h"
+#include <QRunnable>
+
+//-----------------------------------------
+//		*** Mask building ***
+//-----------------------------------------
+
+namespace {
+
+class MaskJob : public QRunnable {
+public:
+	MaskJob(Shape* shape, LayerCache::Entry* entry, int width, int height)
+		: shape(shape), entry(entry), width(width), height(height) {}
+
+	void run() override
+	{
+		Rasterizer rasterizer(nullptr, width, height, 0);
+		rasterizer.setCoverageTarget(entry->mask.data(), entry->bounds);
+		rasterizer.drawShape(*shape);
+		entry->saturated = rasterizer.isCoverageSaturated();
+	}
+
+private:
+	Shape* shape;
+	LayerCache::Entry* entry;
+	int width;
+	int height;
+};
+
+}
+
+//-----------------------------------------
+//		*** Layer cache ***
+//-----------------------------------------
+
+LayerCache::LayerCache(qint64 budgetBytes)
+	: budgetBytes(budgetBytes)
+{
+}
+
+void LayerCache::setEnabled(bool state)
+{
+	enabled = state;
+	if (!enabled) {
+		clear();
+	}
+}
+
+void LayerCache::request(const Shape* shape)
+{
+	if (enabled && !entries.count(shape)) {
+		requested.insert(shape);
+	}
+}
+
+void LayerCache::invalidate(const Shape* shape)
+{
+	requested.erase(shape);
+	auto it = entries.find(shape);
+	if (it != entries.end()) {
+		usedBytes -= static_cast<qint64>(it->second->mask.size());
+		entries.erase(it);
+	}
+}
+
+void LayerCache::clear()
+{
+	entries.clear();
+	requested.clear();
+	usedBytes = 0;
+}
+
+void LayerCache::prepare(const std::vector<Shape*>& shapes, const QRect& area, int canvasWidth, int canvasHeight, QThreadPool& pool)
+{
+	INSTRUMENT_SCOPE("LayerCache::prepare");
+	if (!enabled) {
+		return;
+	}
+
+	// Clipping and trimming depend on the canvas size, so masks of another size are useless; the requests stay
+	if (canvasWidth != width || canvasHeight != height) {
+		entries.clear();
+		usedBytes = 0;
+		width = canvasWidth;
+		height = canvasHeight;
+	}
+
+	if (requested.empty()) {
+		return;
+	}
+
+	std::vector<MaskJob*> jobs;
+	std::vector<Entry*> built;
+	for (Shape* shape : shapes) {
+		if (!requested.count(shape)) {
+			continue;
+		}
+
+		// The mask spans the whole shape, not only area, so later edits elsewhere can reuse it
+		QRect bounds = shape->getBoundingRect().adjusted(-1, -1, 1, 1);
+		if (!bounds.intersects(area)) {
+			continue;
+		}
+		bounds = bounds.intersected(QRect(0, 0, width, height));
+		if (bounds.isEmpty()) {
+			continue;
+		}
+
+		qint64 bytes = static_cast<qint64>(bounds.width()) * bounds.height();
+		if (usedBytes + bytes > budgetBytes) {
+			continue;
+		}
+
+		std::unique_ptr<Entry> entry(new Entry);
+		entry->bounds = bounds;
+		entry->mask.assign(static_cast<size_t>(bytes), 0);
+		jobs.push_back(new MaskJob(shape, entry.get(), width, height));
+		built.push_back(entry.get());
+		usedBytes += bytes;
+		entries[shape] = std::move(entry);
+		requested.erase(shape);
+	}
+
+	if (jobs.size() == 1 || pool.maxThreadCount() <= 1) {
+		for (MaskJob* job : jobs) {
+			job->run();
+			delete job;
+		}
+	}
+	else {
+		for (MaskJob* job : jobs) {
+			pool.start(job);
+		}
+		pool.waitForDone();
+	}
+
+	for (Entry* entry : built) {
+		if (entry->saturated) {
+			usedBytes -= static_cast<qint64>(entry->mask.size());
+			std::vector<uchar>().swap(entry->mask);
+		}
+	}
+}
+
+const LayerCache::Entry* LayerCache::find(const Shape* shape) const
+{
+	auto it = entries.find(shape);
+	return it != entries.end() && !it->second->saturated ? it->second.get() : nullptr;
+}
+
+//-----------------------------------------
+//		*** Compositing ***
+//-----------------------------------------
+
+void LayerCache::composite(const Entry& entry, const Shape& shape, uchar* data, int bytesPerLine, const QRect& clip)
+{
+	QRect area = entry.bounds.intersected(clip);
+	if (area.isEmpty()) {
+		return;
+	}
+
+	const QColor border = shape.getBorderColor();
+	const QColor filling = shape.getFillingColor();
+	const QRgb packedBorder = premultiplyColor(border, shape.getOpacity());
+	const QRgb packedFilling = premultiplyColor(filling, shape.getOpacity());
+	const Shape::BlendMode mode = shape.getBlendMode();
+
+	for (int y = area.top(); y <= area.bottom(); y++) {
+		const uchar* hits = entry.mask.data() + static_cast<size_t>(y - entry.bounds.top()) * entry.bounds.width() - entry.bounds.left();
+		QRgb* row = reinterpret_cast<QRgb*>(data + static_cast<size_t>(y) * bytesPerLine);
+
+		// Neighbouring pixels with the same hit counts are replayed as one span per blend
+		int x = area.left();
+		while (x <= area.right()) {
+			const uchar value = hits[x];
+			int end = x + 1;
+			while (end <= area.right() && hits[end] == value) {
+				end++;
+			}
+
+			if (value) {
+				if (filling.isValid()) {
+					for (int i = 0; i < (value >> 4); i++) {
+						blendSolidSpan(row + x, end - x, packedFilling, mode);
+						INSTRUMENT_COUNT(PixelsWritten, end - x);
+					}
+				}
+				if (border.isValid()) {
+					for (int i = 0; i < (value & 0x0f); i++) {
+						blendSolidSpan(row + x, end - x, packedBorder, mode);
+						INSTRUMENT_COUNT(PixelsWritten, end - x);
+					}
+				}
+			}
+			x = end;
+		}
+	}
+}
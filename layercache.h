@@ -0,0 +1,55 @@
+#pragma once
+#include <QRect>
+#include <QThreadPool>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "representation.h"
+
+// Keeps a coverage mask per shape, cropped to the shape's bounds, so a layer can be composited again
+// without running its scan converter. Each mask byte counts how often the rasterizer hit the pixel:
+// the high nibble counts fill spans, the low nibble border pixels. Compositing replays exactly those
+// blends (fills first, then borders, as the rasterizer does), so the result matches a fresh rasterization
+// for every color, opacity and blend mode. A shape hitting some pixel more than 15 times does not fit
+// the counts; its mask is dropped and the shape is rasterized instead.
+//
+// Masks only pay off for layers drawn again unchanged, as recoloring and reordering do, so a shape gets
+// one only once requested, and only geometry changes invalidate a mask along with its request.
+class LayerCache {
+public:
+	struct Entry {
+		QRect bounds;
+		std::vector<uchar> mask;
+		bool saturated = false;		// Counts overflowed: kept without a mask, so the shape is not measured again
+	};
+
+	explicit LayerCache(qint64 budgetBytes = qint64(256) * 1024 * 1024);
+
+	void setEnabled(bool state);
+	bool isEnabled() const { return enabled; }
+	void setBudget(qint64 bytes) { budgetBytes = bytes; }
+	qint64 getUsedBytes() const { return usedBytes; }
+
+	// Marks shape for a mask, built by the next prepare whose area it reaches
+	void request(const Shape* shape);
+	void invalidate(const Shape* shape);
+	void clear();
+
+	// Builds the missing masks of requested shapes reaching into area; must not overlap with compositing
+	void prepare(const std::vector<Shape*>& shapes, const QRect& area, int canvasWidth, int canvasHeight, QThreadPool& pool);
+	// nullptr for shapes without a usable mask
+	const Entry* find(const Shape* shape) const;
+
+	// Replays a cached layer onto a premultiplied ARGB32 buffer inside clip
+	static void composite(const Entry& entry, const Shape& shape, uchar* data, int bytesPerLine, const QRect& clip);
+
+private:
+	bool enabled = true;
+	qint64 budgetBytes;
+	qint64 usedBytes = 0;
+	int width = 0;
+	int height = 0;
+	std::unordered_map<const Shape*, std::unique_ptr<Entry>> entries;
+	std::unordered_set<const Shape*> requested;
+};
@@ -0,0 +1,316 @@
+#include "layerstack.h"
+#include "instrumentation.h"
+#include <algorithm>
+
+LayerStack::LayerStack()
+{
+}
+
+void LayerStack::clear()
+{
+	nodes.clear();
+	freeNodes.clear();
+	ids.clear();
+	root = -1;
+}
+
+//-----------------------------------------
+//		*** Treap primitives ***
+//-----------------------------------------
+
+void LayerStack::pull(int node)
+{
+	Node& n = nodes[node];
+	n.size = 1 + sizeOf(n.left) + sizeOf(n.right);
+	if (n.left >= 0) {
+		nodes[n.left].parent = node;
+	}
+	if (n.right >= 0) {
+		nodes[n.right].parent = node;
+	}
+}
+
+// Cuts tree into its first count layers and the rest; the parents of the two roots are left to the caller
+void LayerStack::split(int tree, int count, int& left, int& right)
+{
+	if (tree < 0) {
+		left = right = -1;
+		return;
+	}
+
+	int leftSize = sizeOf(nodes[tree].left);
+	if (count <= leftSize) {
+		int rest;
+		split(nodes[tree].left, count, left, rest);
+		nodes[tree].left = rest;
+		right = tree;
+	}
+	else {
+		int rest;
+		split(nodes[tree].right, count - leftSize - 1, rest, right);
+		nodes[tree].right = rest;
+		left = tree;
+	}
+	pull(tree);
+}
+
+int LayerStack::merge(int left, int right)
+{
+	if (left < 0) {
+		return right;
+	}
+	if (right < 0) {
+		return left;
+	}
+
+	if (nodes[left].priority > nodes[right].priority) {
+		nodes[left].right = merge(nodes[left].right, right);
+		pull(left);
+		return left;
+	}
+	nodes[right].left = merge(left, nodes[right].left);
+	pull(right);
+	return right;
+}
+
+int LayerStack::nodeAt(int position) const
+{
+	int node = root;
+	while (node >= 0) {
+		int leftSize = sizeOf(nodes[node].left);
+		if (position < leftSize) {
+			node = nodes[node].left;
+		}
+		else if (position == leftSize) {
+			return node;
+		}
+		else {
+			position -= leftSize + 1;
+			node = nodes[node].right;
+		}
+	}
+	return -1;
+}
+
+int LayerStack::newNode(Shape* shape, int depth)
+{
+	// xorshift32: treap priorities only need to be unpredictable relative to the insertion order
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	Node node = { shape, depth, seed, 1, -1, -1, -1 };
+
+	int index;
+	if (!freeNodes.empty()) {
+		index = freeNodes.back();
+		freeNodes.pop_back();
+		nodes[index] = node;
+	}
+	else {
+		index = static_cast<int>(nodes.size());
+		nodes.push_back(node);
+	}
+	ids[shape] = index;
+	return index;
+}
+
+void LayerStack::releaseNode(int node)
+{
+	ids.erase(nodes[node].shape);
+	nodes[node].shape = nullptr;
+	freeNodes.push_back(node);
+}
+
+int LayerStack::detach(int position)
+{
+	int left, middle, right;
+	split(root, position, left, right);
+	split(right, 1, middle, right);
+	root = merge(left, right);
+	if (root >= 0) {
+		nodes[root].parent = -1;
+	}
+	return middle;
+}
+
+void LayerStack::attach(int node, int position)
+{
+	Node& n = nodes[node];
+	n.left = n.right = n.parent = -1;
+	n.size = 1;
+
+	int left, right;
+	split(root, position, left, right);
+	root = merge(merge(left, node), right);
+	nodes[root].parent = -1;
+}
+
+//-----------------------------------------
+//		*** Editing ***
+//-----------------------------------------
+
+int LayerStack::insert(Shape* shape, int depth)
+{
+	// Depths are sorted, so the slot after the last layer of lower or equal depth is found by descent
+	int position = 0;
+	int node = root;
+	while (node >= 0) {
+		if (nodes[node].depth <= depth) {
+			position += sizeOf(nodes[node].left) + 1;
+			node = nodes[node].right;
+		}
+		else {
+			node = nodes[node].left;
+		}
+	}
+
+	int id = newNode(shape, depth);
+	attach(id, position);
+	return id;
+}
+
+void LayerStack::insertBulk(const std::vector<std::pair<Shape*, int>>& shapes)
+{
+	INSTRUMENT_SCOPE("LayerStack::insertBulk");
+	std::vector<int> added;
+	added.reserve(shapes.size());
+	for (const auto& entry : shapes) {
+		added.push_back(newNode(entry.first, entry.second));
+	}
+	std::stable_sort(added.begin(), added.end(), [this](int a, int b) { return nodes[a].depth < nodes[b].depth; });
+
+	std::vector<int> existing;
+	inorder(existing);
+	std::vector<int> order;
+	order.reserve(existing.size() + added.size());
+	std::merge(existing.begin(), existing.end(), added.begin(), added.end(), std::back_inserter(order),
+		[this](int a, int b) { return nodes[a].depth < nodes[b].depth; });
+	build(order);
+}
+
+void LayerStack::removeAt(int position)
+{
+	if (position < 0 || position >= size()) {
+		return;
+	}
+	releaseNode(detach(position));
+}
+
+void LayerStack::swapAdjacent(int position)
+{
+	if (position < 0 || position + 1 >= size()) {
+		return;
+	}
+
+	int lower = nodeAt(position);
+	int upper = nodeAt(position + 1);
+	std::swap(nodes[lower].depth, nodes[upper].depth);
+	attach(detach(position + 1), position);
+}
+
+//-----------------------------------------
+//		*** Lookup ***
+//-----------------------------------------
+
+int LayerStack::idOf(const Shape* shape) const
+{
+	auto found = ids.find(shape);
+	return found != ids.end() ? found->second : -1;
+}
+
+int LayerStack::positionOf(int id) const
+{
+	if (id < 0 || id >= static_cast<int>(nodes.size()) || !nodes[id].shape) {
+		return -1;
+	}
+
+	int position = sizeOf(nodes[id].left);
+	for (int node = id; nodes[node].parent >= 0; node = nodes[node].parent) {
+		int parent = nodes[node].parent;
+		if (nodes[parent].right == node) {
+			position += sizeOf(nodes[parent].left) + 1;
+		}
+	}
+	return position;
+}
+
+void LayerStack::inorder(std::vector<int>& order) const
+{
+	order.clear();
+	order.reserve(size());
+	std::vector<int> pending;
+	int node = root;
+	while (node >= 0 || !pending.empty()) {
+		while (node >= 0) {
+			pending.push_back(node);
+			node = nodes[node].left;
+		}
+		node = pending.back();
+		pending.pop_back();
+		order.push_back(node);
+		node = nodes[node].right;
+	}
+}
+
+void LayerStack::forEach(const std::function<void(Shape*, int)>& visit) const
+{
+	std::vector<int> order;
+	inorder(order);
+	for (int node : order) {
+		visit(nodes[node].shape, nodes[node].depth);
+	}
+}
+
+void LayerStack::collect(std::vector<Shape*>& shapes) const
+{
+	std::vector<int> order;
+	inorder(order);
+	shapes.clear();
+	shapes.reserve(order.size());
+	for (int node : order) {
+		shapes.push_back(nodes[node].shape);
+	}
+}
+
+// Cartesian tree construction over nodes already in position order, O(n)
+void LayerStack::build(const std::vector<int>& order)
+{
+	std::vector<int> spine;
+	for (int node : order) {
+		int last = -1;
+		while (!spine.empty() && nodes[spine.back()].priority < nodes[node].priority) {
+			last = spine.back();
+			spine.pop_back();
+		}
+		nodes[node].left = last;
+		nodes[node].right = -1;
+		if (!spine.empty()) {
+			nodes[spine.back()].right = node;
+		}
+		spine.push_back(node);
+	}
+	root = spine.empty() ? -1 : spine.front();
+	if (root < 0) {
+		return;
+	}
+
+	// Sizes and parent links bottom up: children precede their parents in reversed preorder
+	std::vector<int> preorder;
+	preorder.reserve(order.size());
+	spine.assign(1, root);
+	while (!spine.empty()) {
+		int node = spine.back();
+		spine.pop_back();
+		preorder.push_back(node);
+		if (nodes[node].left >= 0) {
+			spine.push_back(nodes[node].left);
+		}
+		if (nodes[node].right >= 0) {
+			spine.push_back(nodes[node].right);
+		}
+	}
+	for (auto it = preorder.rbegin(); it != preorder.rend(); ++it) {
+		pull(*it);
+	}
+	nodes[root].parent = -1;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <QtGlobal>
+#include <functional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "representation.h"
+
+// The shapes of a scene in painter's order (position 0 is drawn first), as an implicit treap:
+// a randomized binary tree ordered by position, with subtree sizes for rank and selection and parent
+// links to walk up from a node. Insert, remove, swap, position lookup and id lookup are O(log n).
+//
+// Every layer has a stable id, valid until the layer is removed, and a depth. Depths never decrease
+// from bottom to top: insert() places a shape after all layers of lower or equal depth, and swaps exchange
+// depths along with positions.
+class LayerStack {
+public:
+	LayerStack();
+
+	int size() const { return root < 0 ? 0 : nodes[root].size; }
+	bool isEmpty() const { return root < 0; }
+	void clear();
+
+	// Returns the new layer's id
+	int insert(Shape* shape, int depth);
+	// Inserts all shapes (stable by depth, after existing layers of equal depth) and rebuilds the tree once, O(n + k log k)
+	void insertBulk(const std::vector<std::pair<Shape*, int>>& shapes);
+	void removeAt(int position);
+	// Exchanges the layers at position and position + 1
+	void swapAdjacent(int position);
+
+	Shape* at(int position) const { return nodes[nodeAt(position)].shape; }
+	int depthAt(int position) const { return nodes[nodeAt(position)].depth; }
+	int idAt(int position) const { return nodeAt(position); }
+	// One above the depth of the top layer, so a shape inserted with it becomes the new top layer
+	int nextDepth() const { return root < 0 ? 0 : depthAt(size() - 1) + 1; }
+	Shape* shapeOf(int id) const { return nodes[id].shape; }
+
+	// -1 for shapes and ids that are not in the stack
+	int idOf(const Shape* shape) const;
+	int positionOf(int id) const;
+	int positionOf(const Shape* shape) const { return positionOf(idOf(shape)); }
+
+	// Visits every layer bottom to top with its depth
+	void forEach(const std::function<void(Shape*, int)>& visit) const;
+	void collect(std::vector<Shape*>& shapes) const;
+
+private:
+	// The node index doubles as the layer id
+	struct Node {
+		Shape* shape;
+		int depth;
+		quint32 priority;
+		int size;
+		int left;
+		int right;
+		int parent;
+	};
+
+	std::vector<Node> nodes;
+	std::vector<int> freeNodes;
+	std::unordered_map<const Shape*, int> ids;
+	int root = -1;
+	quint32 seed = 0x9e3779b9u;
+
+	int sizeOf(int node) const { return node < 0 ? 0 : nodes[node].size; }
+	void pull(int node);
+	void split(int tree, int count, int& left, int& right);
+	int merge(int left, int right);
+	int nodeAt(int position) const;
+	int newNode(Shape* shape, int depth);
+	void releaseNode(int node);
+	int detach(int position);
+	void attach(int node, int position);
+	void inorder(std::vector<int>& order) const;
+	void build(const std::vector<int>& order);
+};
@@ -1,4 +1,5 @@
 #include "ImageViewer.h"
+#include "instrumentation.h"
 #include <QtWidgets/QApplication>
 
 int main(int argc, char* argv[])
@@ -9,6 +10,9 @@ int main(int argc, char* argv[])
 	QCoreApplication::setApplicationName("ImageViewer");
 
 	QApplication a(argc, argv);
+	// Instrumented builds report on exit and write a Chrome trace to $IMAGEVIEWER_TRACE
+	INSTRUMENT_SESSION(QString::fromLocal8Bit(qgetenv("IMAGEVIEWER_TRACE")));
+
 	ImageViewer w;
 	w.show();
 	return a.exec();
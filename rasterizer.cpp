@@ -0,0 +1,708 @@
+#include "rasterizer.h"
+#include "instrumentation.h"
+#include "clipping.h"
+#include <QDebug>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+void Rasterizer::setTarget(uchar* targetData, int targetWidth, int targetHeight, int targetBytesPerLine)
+{
+	data = targetData;
+	width = targetWidth;
+	height = targetHeight;
+	bytesPerLine = targetBytesPerLine;
+	clipRect = QRect(0, 0, width, height);
+}
+
+void Rasterizer::setCoverageTarget(uchar* mask, const QRect& maskRect)
+{
+	coverage = mask;
+	coverageStride = maskRect.width();
+	coverageOrigin = maskRect.topLeft();
+	coverageSaturated = false;
+	setClipRect(maskRect);
+}
+
+void Rasterizer::loadShapeStyle(const Shape& shape) {
+	borderColor = shape.getBorderColor();
+	fillingColor = shape.getFillingColor();
+	blendMode = shape.getBlendMode();
+	layerOpacity = shape.getOpacity();
+
+	// Coverage does not depend on color, so it is recorded even for a shape drawn without one
+	if (coverage) {
+		if (!borderColor.isValid()) {
+			borderColor = Qt::black;
+		}
+		if (!fillingColor.isValid()) {
+			fillingColor = Qt::black;
+		}
+	}
+}
+
+//-----------------------------------------
+//		*** Pixel and span functions ***
+//-----------------------------------------
+
+void Rasterizer::blendPixelAt(int x, int y, QRgb packedColor)
+{
+	if (!clipRect.contains(x, y)) {
+		return;
+	}
+
+	if (coverage) {
+		uchar& hits = coverage[(y - coverageOrigin.y()) * coverageStride + (x - coverageOrigin.x())];
+		if ((hits & 0x0f) != 0x0f) {
+			hits++;
+		}
+		else {
+			coverageSaturated = true;
+		}
+		return;
+	}
+
+	INSTRUMENT_COUNT(PixelsWritten, 1);
+	size_t startbyte = y * bytesPerLine + x * 4;
+	blendPixel(reinterpret_cast<QRgb*>(data + startbyte), packedColor, blendMode);
+}
+
+void Rasterizer::fillSpan(int y, int x0, int x1, QRgb packedColor)
+{
+	if (y < clipRect.top() || y > clipRect.bottom()) {
+		return;
+	}
+
+	// Clip the whole run once instead of testing every pixel
+	x0 = std::max(x0, clipRect.left());
+	x1 = std::min(x1, clipRect.right());
+	if (x0 > x1) {
+		return;
+	}
+
+	if (coverage) {
+		uchar* hits = coverage + (y - coverageOrigin.y()) * coverageStride - coverageOrigin.x();
+		for (int x = x0; x <= x1; x++) {
+			if ((hits[x] & 0xf0) != 0xf0) {
+				hits[x] += 0x10;
+			}
+			else {
+				coverageSaturated = true;
+			}
+		}
+		return;
+	}
+
+	INSTRUMENT_COUNT(PixelsWritten, x1 - x0 + 1);
+	QRgb* row = reinterpret_cast<QRgb*>(data + static_cast<size_t>(y) * bytesPerLine);
+	blendSolidSpan(row + x0, x1 - x0 + 1, packedColor, blendMode);
+}
+
+void Rasterizer::fillSpans(const std::vector<Span>& spans, QRgb packedColor)
+{
+	for (const Span& span : spans) {
+		fillSpan(span.y, span.x0, span.x1, packedColor);
+	}
+}
+
+//-----------------------------------------
+//		*** Drawing functions ***
+//-----------------------------------------
+void Rasterizer::drawShape(Shape& shape) {
+	switch (shape.getType()) {
+	case Shape::LINE:
+		drawLine(static_cast<Line&>(shape));
+		break;
+	case Shape::RECTANGLE:
+		drawRectangle(static_cast<MyRectangle&>(shape));
+		break;
+	case Shape::POLYGON:
+		drawPolygon(static_cast<MyPolygon&>(shape));
+		break;
+	case Shape::CIRCLE:
+		drawCircle(static_cast<Circle&>(shape));
+		break;
+	case Shape::BEZIER_CURVE:
+		drawCurve(static_cast<BezierCurve&>(shape));
+		break;
+	default:
+		break;
+	}
+}
+
+//-----------------------------------------
+//		*** Line functions ***
+//-----------------------------------------
+void Rasterizer::drawLine(Line& line)
+{
+	INSTRUMENT_SCOPE("Rasterizer::drawLine");
+	INSTRUMENT_COUNT(ShapesRasterized, 1);
+	loadShapeStyle(line);
+
+	PointSpan linePoints = line.pointSpan();
+	if (linePoints.size() < 2) {
+		return;
+	}
+
+	drawLineBresenham(linePoints[0], linePoints[1]);
+}
+
+void Rasterizer::drawLineBresenham(QVector<QPoint>& linePoints) {
+	drawLineBresenham(linePoints.first(), linePoints.last());
+}
+
+void Rasterizer::drawLineBresenham(const QPoint& start, const QPoint& end) {
+	if (!borderColor.isValid()) {
+		return;
+	}
+
+	traceSegment(start, end, premultiplyColor(borderColor, layerOpacity), true);
+}
+
+// Bresenham walk clipped in step space. Step k lies at major + k and minor + m(k), with
+// m(k) = floor((2 * dMinor * k + dMajor) / (2 * dMajor)), so the visible steps form one range whose
+// ends and decision value follow in closed form. The walk then plots exactly the pixels the unclipped
+// line has inside clipRect, which keeps tile seams invisible, without testing any pixel.
+void Rasterizer::traceSegment(const QPoint& start, const QPoint& end, QRgb packedBorder, bool includeEnd) {
+	const int dx = end.x() - start.x();
+	const int dy = end.y() - start.y();
+	const bool xMajor = abs(dx) > abs(dy);
+	const qint64 dMajor = xMajor ? abs(dx) : abs(dy);
+	const qint64 dMinor = xMajor ? abs(dy) : abs(dx);
+
+	if (dMajor == 0) {
+		if (includeEnd) {
+			blendPixelAt(start.x(), start.y(), packedBorder);
+		}
+		return;
+	}
+
+	// Cohen-Sutherland outcodes: both ends inside draws everything, a shared outside half-plane nothing
+	auto outcode = [this](const QPoint& point) {
+		return (point.x() < clipRect.left() ? 1 : 0) | (point.x() > clipRect.right() ? 2 : 0) |
+			(point.y() < clipRect.top() ? 4 : 0) | (point.y() > clipRect.bottom() ? 8 : 0);
+	};
+	const int startCode = outcode(start);
+	const int endCode = outcode(end);
+	if (startCode & endCode) {
+		return;
+	}
+
+	const int majorStart = xMajor ? start.x() : start.y();
+	const int minorStart = xMajor ? start.y() : start.x();
+	const int majorStep = (xMajor ? dx : dy) > 0 ? 1 : -1;
+	const int minorStep = (xMajor ? dy : dx) > 0 ? 1 : -1;
+
+	qint64 first = 0;
+	qint64 last = includeEnd ? dMajor : dMajor - 1;
+
+	if (startCode | endCode) {
+		const int majorLow = xMajor ? clipRect.left() : clipRect.top();
+		const int majorHigh = xMajor ? clipRect.right() : clipRect.bottom();
+		const int minorLow = xMajor ? clipRect.top() : clipRect.left();
+		const int minorHigh = xMajor ? clipRect.bottom() : clipRect.right();
+
+		// Steps whose major coordinate is inside
+		if (majorStep > 0) {
+			first = qMax<qint64>(first, majorLow - majorStart);
+			last = qMin<qint64>(last, majorHigh - majorStart);
+		}
+		else {
+			first = qMax<qint64>(first, majorStart - majorHigh);
+			last = qMin<qint64>(last, majorStart - majorLow);
+		}
+
+		// Minor offsets inside, then the steps reaching them; m(k) never decreases
+		qint64 offsetLow = minorStep > 0 ? minorLow - minorStart : minorStart - minorHigh;
+		qint64 offsetHigh = minorStep > 0 ? minorHigh - minorStart : minorStart - minorLow;
+		if (offsetHigh < 0) {
+			return;
+		}
+		if (offsetLow > 0) {
+			if (dMinor == 0) {
+				return;
+			}
+			first = qMax(first, (2 * dMajor * offsetLow - dMajor + 2 * dMinor - 1) / (2 * dMinor));
+		}
+		if (dMinor > 0) {
+			last = qMin(last, (2 * dMajor * (offsetHigh + 1) - dMajor + 2 * dMinor - 1) / (2 * dMinor) - 1);
+		}
+	}
+	if (first > last) {
+		return;
+	}
+
+	const qint64 minorOffset = (2 * dMinor * first + dMajor) / (2 * dMajor);
+	const int x = xMajor ? majorStart + majorStep * static_cast<int>(first) : minorStart + minorStep * static_cast<int>(minorOffset);
+	const int y = xMajor ? minorStart + minorStep * static_cast<int>(minorOffset) : majorStart + majorStep * static_cast<int>(first);
+	qint64 p = 2 * dMinor * (first + 1) - dMajor - 2 * dMajor * minorOffset; // Decision value at step first
+	const qint64 k1 = 2 * dMinor;				// Constant for a major step
+	const qint64 k2 = 2 * (dMinor - dMajor);	// Constant for a diagonal step
+	const int count = static_cast<int>(last - first + 1);
+
+	if (coverage) {
+		const ptrdiff_t majorStride = xMajor ? majorStep : majorStep * coverageStride;
+		const ptrdiff_t minorStride = xMajor ? minorStep * coverageStride : minorStep;
+		uchar* hits = coverage + (y - coverageOrigin.y()) * coverageStride + (x - coverageOrigin.x());
+		for (int i = 0; i < count; i++) {
+			if ((*hits & 0x0f) != 0x0f) {
+				(*hits)++;
+			}
+			else {
+				coverageSaturated = true;
+			}
+			hits += majorStride;
+			if (p >= 0) {
+				hits += minorStride;
+				p += k2;
+			}
+			else {
+				p += k1;
+			}
+		}
+		return;
+	}
+
+	INSTRUMENT_COUNT(PixelsWritten, count);
+	const ptrdiff_t majorStride = xMajor ? majorStep * 4 : majorStep * static_cast<ptrdiff_t>(bytesPerLine);
+	const ptrdiff_t minorStride = xMajor ? minorStep * static_cast<ptrdiff_t>(bytesPerLine) : minorStep * 4;
+	uchar* pixel = data + static_cast<ptrdiff_t>(y) * bytesPerLine + x * 4;
+	for (int i = 0; i < count; i++) {
+		blendPixel(reinterpret_cast<QRgb*>(pixel), packedBorder, blendMode);
+		pixel += majorStride;
+		if (p >= 0) {
+			pixel += minorStride;
+			p += k2;
+		}
+		else {
+			p += k1;
+		}
+	}
+}
+
+//-----------------------------------------
+//		*** Polyline functions ***
+//-----------------------------------------
+void Rasterizer::drawPolyline(const QPoint* points, int count, bool closed) {
+	if (count < 1 || !borderColor.isValid()) {
+		return;
+	}
+
+	// Whole outlines off the clip rectangle are rejected once, single segments by their outcodes
+	int left = points[0].x(), right = left, top = points[0].y(), bottom = top;
+	for (int i = 1; i < count; i++) {
+		left = qMin(left, points[i].x());
+		right = qMax(right, points[i].x());
+		top = qMin(top, points[i].y());
+		bottom = qMax(bottom, points[i].y());
+	}
+	if (!QRect(QPoint(left, top), QPoint(right, bottom)).intersects(clipRect)) {
+		return;
+	}
+
+	const QRgb packedBorder = premultiplyColor(borderColor, layerOpacity);
+
+	// Each segment stops short of its end vertex, which the next segment starts on
+	for (int i = 0; i + 1 < count; i++) {
+		traceSegment(points[i], points[i + 1], packedBorder, false);
+	}
+	if (closed && count > 2) {
+		traceSegment(points[count - 1], points[0], packedBorder, false);
+	}
+	else {
+		blendPixelAt(points[count - 1].x(), points[count - 1].y(), packedBorder);
+	}
+}
+
+//-----------------------------------------
+//		*** Circle functions ***
+//-----------------------------------------
+void Rasterizer::drawCircle(Circle& circle) {
+	INSTRUMENT_SCOPE("Rasterizer::drawCircle");
+	INSTRUMENT_COUNT(ShapesRasterized, 1);
+	loadShapeStyle(circle);
+	PointSpan points = circle.pointSpan();
+	QPoint center = points[0];
+	QPoint radiusPoint = points[1];
+	int r = std::sqrt(std::pow(radiusPoint.x() - center.x(), 2) + std::pow(radiusPoint.y() - center.y(), 2));
+	int x = 0;
+	int y = r;
+	int p = 1 - r;
+
+	if (circle.getIsFilled()) {
+		fillCircle(center, r);
+		return;
+	}
+
+	drawSymmetricPoints(center, x, y);
+
+	while (x < y) {
+		x++;
+		if (p < 0) {
+			p += 2 * x + 1;
+		}
+		else {
+			y--;
+			p += 2 * (x - y) + 1;
+		}
+
+		drawSymmetricPoints(center, x, y);
+	}
+}
+
+void Rasterizer::drawSymmetricPoints(const QPoint& center, int x, int y) {
+	QPoint points[8] = {
+		QPoint(x, y),
+		QPoint(y, x),
+		QPoint(-x, y),
+		QPoint(-y, x),
+		QPoint(-x, -y),
+		QPoint(-y, -x),
+		QPoint(x, -y),
+		QPoint(y, -x)
+	};
+
+	if (!borderColor.isValid()) {
+		return;
+	}
+
+	const QRgb packedBorder = premultiplyColor(borderColor, layerOpacity);
+	for (auto& point : points) {
+		blendPixelAt(center.x() + point.x(), center.y() + point.y(), packedBorder);
+	}
+}
+
+void Rasterizer::fillCircle(const QPoint& center, int r) {
+	INSTRUMENT_SCOPE("Rasterizer::fillCircle");
+	if (!fillingColor.isValid() || r < 0) {
+		return;
+	}
+
+	// Widest half-width reached on each row offset, so every row becomes a single span
+	std::vector<int> halfWidth(r + 1, -1);
+	int x = 0;
+	int y = r;
+	int p = 1 - r;
+
+	while (true) {
+		halfWidth[y] = std::max(halfWidth[y], x);
+		halfWidth[x] = std::max(halfWidth[x], y);
+		if (x >= y) {
+			break;
+		}
+
+		x++;
+		if (p < 0) {
+			p += 2 * x + 1;
+		}
+		else {
+			y--;
+			p += 2 * (x - y) + 1;
+		}
+	}
+
+	spanBuffer.clear();
+	for (int dy = 0; dy <= r; dy++) {
+		if (halfWidth[dy] < 0) {
+			continue;
+		}
+		spanBuffer.push_back({ center.y() + dy, center.x() - halfWidth[dy], center.x() + halfWidth[dy] });
+		if (dy != 0) {
+			spanBuffer.push_back({ center.y() - dy, center.x() - halfWidth[dy], center.x() + halfWidth[dy] });
+		}
+	}
+
+	fillSpans(spanBuffer, premultiplyColor(fillingColor, layerOpacity));
+}
+
+//-----------------------------------------
+//		*** Polygon functions ***
+//-----------------------------------------
+void Rasterizer::drawPolygon(MyPolygon& polygon) {
+	INSTRUMENT_SCOPE("Rasterizer::drawPolygon");
+	INSTRUMENT_COUNT(ShapesRasterized, 1);
+	loadShapeStyle(polygon);
+	PointSpan pointsVector = polygon.pointSpan();
+
+	if (pointsVector.size() < 2) {
+		return;
+	}
+
+	if (polygon.getIsFilled()) {
+		fillPolygon(polygon);
+	}
+
+	clipOutlineToCanvas(pointsVector);
+	drawPolyline(outlineBuffer.data(), static_cast<int>(outlineBuffer.size()), true);
+}
+
+// Outlines reaching past the canvas are trimmed to it, so the cut runs along the canvas border
+void Rasterizer::clipOutlineToCanvas(PointSpan points) {
+	INSTRUMENT_SCOPE("Rasterizer::clipOutlineToCanvas");
+	outlineBuffer.clear();
+	int count = clipPolygonToRect(points.data, points.size(), QRectF(0, 0, width - 1, height - 1), clipOutput, clipScratch);
+
+	// Whole pixels, without the repeats that rounding leaves behind
+	for (int i = 0; i < count; i++) {
+		QPoint point = clipOutput[i].toPoint();
+		if (outlineBuffer.empty() || outlineBuffer.back() != point) {
+			outlineBuffer.push_back(point);
+		}
+	}
+	while (outlineBuffer.size() > 1 && outlineBuffer.back() == outlineBuffer.front()) {
+		outlineBuffer.pop_back();
+	}
+}
+
+QVector<QPoint> Rasterizer::trimPolygon(Shape& polygon) {
+	clipOutlineToCanvas(polygon.pointSpan());
+	return QVector<QPoint>(outlineBuffer.begin(), outlineBuffer.end());
+}
+
+//-----------------------------------------
+//		*** Polygon filling ***
+//-----------------------------------------
+// Scan line fill with an edge table bucketed by starting row. Edges step in 16.16 fixed point and the
+// active edge list stays sorted by x: entering edges are inserted in place and one insertion pass after
+// each step restores the order where edges cross. Only rows inside the clip rectangle are visited.
+void Rasterizer::fillPolygon(Shape& polygon) {
+	INSTRUMENT_SCOPE("Rasterizer::fillPolygon");
+	PointSpan points = polygon.pointSpan();
+	if (points.isEmpty() || !fillingColor.isValid()) {
+		return;
+	}
+
+	int minX = points[0].x(), maxX = minX, minY = points[0].y(), maxY = minY;
+	for (const QPoint& point : points) {
+		minX = qMin(minX, point.x());
+		maxX = qMax(maxX, point.x());
+		minY = qMin(minY, point.y());
+		maxY = qMax(maxY, point.y());
+	}
+
+	// An edge covers rows [top.y, bottom.y - 1], so the vertex shared by two edges is counted once
+	if (minY >= maxY - 1) {
+		return;
+	}
+	int firstRow = qMax(minY, clipRect.top());
+	int lastRow = qMin(maxY - 1, clipRect.bottom());
+	if (firstRow > lastRow || maxX < clipRect.left() || minX > clipRect.right()) {
+		return;
+	}
+
+	fillEdges.clear();
+	auto addEdge = [this](QPoint top, QPoint bottom) {
+		if (top.y() > bottom.y()) {
+			std::swap(top, bottom);
+		}
+		FillEdge edge;
+		edge.x = static_cast<qint64>(top.x()) << 16;
+		qint64 run = static_cast<qint64>(bottom.x() - top.x()) << 16;
+		qint64 rise = bottom.y() - top.y();
+		edge.dxdy = (run >= 0 ? run + rise / 2 : run - rise / 2) / rise; // Rounded to the nearest step
+		edge.yTop = top.y();
+		edge.yLast = bottom.y() - 1;
+		edge.next = -1;
+		fillEdges.push_back(edge);
+	};
+
+	// Edges wholly left or right of the clip rectangle only decide the parity of the pixels inside, so they
+	// are moved onto the column just outside it, where they round to a pixel that is never written. A run of
+	// such edges on one side then collapses into a single vertical edge between its end rows, leaving
+	// off-screen parts of the polygon almost free while every pixel inside comes out as before.
+	const bool inside = minX >= clipRect.left() && maxX <= clipRect.right();
+	int runSide = 0;
+	int runStartY = 0, runEndY = 0;
+	auto flushRun = [&]() {
+		if (runSide != 0 && runStartY != runEndY) {
+			int x = runSide < 0 ? clipRect.left() - 1 : clipRect.right() + 1;
+			addEdge(QPoint(x, runStartY), QPoint(x, runEndY));
+		}
+		runSide = 0;
+	};
+
+	for (int i = 0; i < points.size(); i++) {
+		const QPoint& start = points[i];
+		const QPoint& end = points[(i + 1) % points.size()];
+
+		int side = 0;
+		if (!inside) {
+			if (qMax(start.x(), end.x()) < clipRect.left()) {
+				side = -1;
+			}
+			else if (qMin(start.x(), end.x()) > clipRect.right()) {
+				side = 1;
+			}
+		}
+		if (side != 0) {
+			if (side != runSide) {
+				flushRun();
+				runSide = side;
+				runStartY = start.y();
+			}
+			runEndY = end.y();
+			continue;
+		}
+		flushRun();
+
+		// Horizontal edges never cross a scan line, and their infinite inverse slope would spill the fill across the row
+		if (start.y() == end.y()) {
+			continue;
+		}
+		addEdge(start, end);
+	}
+	flushRun();
+
+	// Edges that start above the clip rectangle are advanced to its first row in one step
+	edgeBuckets.assign(lastRow - firstRow + 1, -1);
+	for (int i = 0; i < static_cast<int>(fillEdges.size()); i++) {
+		FillEdge& edge = fillEdges[i];
+		if (edge.yLast < firstRow || edge.yTop > lastRow) {
+			continue;
+		}
+		int startRow = qMax(edge.yTop, firstRow);
+		edge.x += (startRow - edge.yTop) * edge.dxdy;
+		edge.next = edgeBuckets[startRow - firstRow];
+		edgeBuckets[startRow - firstRow] = i;
+	}
+
+	QRgb packedColor = premultiplyColor(fillingColor, layerOpacity);
+	FillEdge* edges = fillEdges.data();
+	activeEdges.clear();
+
+	for (int y = firstRow; y <= lastRow; y++) {
+		// Entering edges are inserted at their x position
+		for (int i = edgeBuckets[y - firstRow]; i != -1; i = edges[i].next) {
+			activeEdges.push_back(i);
+			for (size_t k = activeEdges.size() - 1; k > 0 && edges[activeEdges[k - 1]].x > edges[i].x; k--) {
+				std::swap(activeEdges[k - 1], activeEdges[k]);
+			}
+		}
+
+		// Spans between pairs of crossings, x rounded half up
+		for (size_t k = 0; k + 1 < activeEdges.size(); k += 2) {
+			int startX = static_cast<int>((edges[activeEdges[k]].x + 0x8000) >> 16);
+			int endX = static_cast<int>((edges[activeEdges[k + 1]].x + 0x8000) >> 16);
+			fillSpan(y, startX, endX, packedColor);
+		}
+
+		// Edges ending on this row leave, the rest step to the next row
+		size_t kept = 0;
+		for (size_t k = 0; k < activeEdges.size(); k++) {
+			FillEdge& edge = edges[activeEdges[k]];
+			if (edge.yLast == y) {
+				continue;
+			}
+			edge.x += edge.dxdy;
+			activeEdges[kept++] = activeEdges[k];
+		}
+		activeEdges.resize(kept);
+
+		// Crossing edges swap places; the list is otherwise still sorted, so this pass is linear
+		for (size_t k = 1; k < activeEdges.size(); k++) {
+			int moving = activeEdges[k];
+			size_t j = k;
+			for (; j > 0 && edges[activeEdges[j - 1]].x > edges[moving].x; j--) {
+				activeEdges[j] = activeEdges[j - 1];
+			}
+			activeEdges[j] = moving;
+		}
+	}
+}
+
+//-----------------------------------------
+//		*** Curve functions ***
+//-----------------------------------------
+// Splits the curve at t = 1/2 until its control polygon lies within curveTolerance of the chord,
+// appending the end point of every flat piece to curvePolyline
+void Rasterizer::flattenBezier(const QPointF* control, int count, int depth) {
+	const QPointF& first = control[0];
+	const QPointF& last = control[count - 1];
+	QPointF chord = last - first;
+	double chordLengthSquared = chord.x() * chord.x() + chord.y() * chord.y();
+
+	// The curve stays inside the hull of its control points, so their distance from the chord bounds the error.
+	// The distance is to the chord as a segment: a control point in line with it but beyond an end pulls the
+	// curve past that end, which the chord alone would cut off.
+	bool flat = true;
+	for (int i = 1; i < count - 1 && flat; i++) {
+		QPointF offset = control[i] - first;
+		double along = 0.0;
+		if (chordLengthSquared > 0) {
+			along = std::min(std::max((offset.x() * chord.x() + offset.y() * chord.y()) / chordLengthSquared, 0.0), 1.0);
+		}
+		QPointF away = offset - chord * along;
+		double distanceSquared = away.x() * away.x() + away.y() * away.y();
+		flat = distanceSquared <= curveTolerance * curveTolerance;
+	}
+
+	if (flat || depth == maxCurveDepth) {
+		QPoint end = last.toPoint();
+		if (end != curvePolyline.back()) {
+			curvePolyline.push_back(end);
+		}
+		return;
+	}
+
+	// De Casteljau split: row r of the triangle starts with left[r] and ends with right[count - 1 - r]
+	QPointF* left = curveScratch.data() + count + 2 * count * depth;
+	QPointF* right = left + count;
+	std::copy(control, control + count, right);
+	for (int r = 0; r < count; r++) {
+		left[r] = right[0];
+		for (int k = 0; k < count - 1 - r; k++) {
+			right[k] = (right[k] + right[k + 1]) * 0.5;
+		}
+	}
+
+	flattenBezier(left, count, depth + 1);
+	flattenBezier(right, count, depth + 1);
+}
+
+void Rasterizer::drawCurve(BezierCurve& curve) {
+	INSTRUMENT_SCOPE("Rasterizer::drawCurve");
+	INSTRUMENT_COUNT(ShapesRasterized, 1);
+	// << Beziérova krivka >>
+	loadShapeStyle(curve);
+	PointSpan curvePoints = curve.pointSpan();
+	if (curvePoints.size() < 2 || !borderColor.isValid()) {
+		return;
+	}
+
+	int count = curvePoints.size();
+	curveScratch.resize(static_cast<size_t>(count + 2 * count * maxCurveDepth));
+	QPointF* control = curveScratch.data();
+	for (int i = 0; i < count; i++) {
+		control[i] = curvePoints[i];
+	}
+
+	curvePolyline.clear();
+	curvePolyline.push_back(curvePoints.first());
+	flattenBezier(control, count, 0);
+	if (curvePolyline.size() == 1) {
+		curvePolyline.push_back(curvePoints.last());
+	}
+
+	drawPolyline(curvePolyline.data(), static_cast<int>(curvePolyline.size()), false);
+}
+
+//-----------------------------------------
+//		*** Rectangle functions ***
+//-----------------------------------------
+void Rasterizer::drawRectangle(MyRectangle& rectangle) {
+	INSTRUMENT_SCOPE("Rasterizer::drawRectangle");
+	INSTRUMENT_COUNT(ShapesRasterized, 1);
+	loadShapeStyle(rectangle);
+	PointSpan pointsVector = rectangle.pointSpan();
+
+	if (pointsVector.size() < 2) {
+		return;
+	}
+
+	if (rectangle.getIsFilled()) {
+		fillPolygon(rectangle);
+	}
+
+	clipOutlineToCanvas(pointsVector);
+	drawPolyline(outlineBuffer.data(), static_cast<int>(outlineBuffer.size()), true);
+}
\ No newline at end of file
@@ -0,0 +1,126 @@
+#pragma once
+#include <QImage>
+#include <QPointF>
+#include <QRect>
+#include <QVector>
+#include <vector>
+#include "representation.h"
+#include "compositing.h"
+
+// Horizontal run of pixels [x0, x1] on row y
+struct Span {
+	int y;
+	int x0;
+	int x1;
+};
+
+// Draws shapes into a premultiplied ARGB32 pixel buffer. It has no widget or painter of its own,
+// so several rasterizers may work on disjoint clip rectangles of the same buffer at once.
+class Rasterizer {
+private:
+	uchar* data = nullptr;
+	int width = 0;
+	int height = 0;
+	int bytesPerLine = 0;
+	QRect clipRect;
+
+	QColor borderColor, fillingColor;
+	Shape::BlendMode blendMode = Shape::SOURCE_OVER;
+	double layerOpacity = 1.0;
+
+	std::vector<Span> spanBuffer;
+
+	// Non-horizontal polygon edge for the scan line fill, with x in 16.16 fixed point on the current row
+	struct FillEdge {
+		qint64 x;
+		qint64 dxdy;
+		int yTop;
+		int yLast;   // Last scan line the edge is active on
+		int next;    // Next edge starting on the same scan line, -1 ends the bucket
+	};
+
+	// Scan line fill scratch, reused between polygons: edges, per row bucket heads and the active edge list
+	std::vector<FillEdge> fillEdges;
+	std::vector<int> edgeBuckets;
+	std::vector<int> activeEdges;
+
+	// Bezier flattening: largest allowed distance in pixels between the curve and its outline, subdivision
+	// scratch holding a left and a right control polygon per depth level, and the flattened outline
+	static const int maxCurveDepth = 16;
+	double curveTolerance = 0.25;
+	std::vector<QPointF> curveScratch;
+	std::vector<QPoint> curvePolyline;
+	void flattenBezier(const QPointF* control, int count, int depth);
+
+	// Bresenham walk from start to end, clipped to clipRect; the end pixel is left out unless includeEnd
+	void traceSegment(const QPoint& start, const QPoint& end, QRgb packedBorder, bool includeEnd);
+
+	// Outline clipping scratch (see clipPolygonToRect) and the clipped outline in whole pixels
+	std::vector<QPointF> clipOutput, clipScratch;
+	std::vector<QPoint> outlineBuffer;
+	void clipOutlineToCanvas(PointSpan points);
+
+	// Coverage mode: hits are counted into a mask instead of being blended (see LayerCache)
+	uchar* coverage = nullptr;
+	int coverageStride = 0;
+	QPoint coverageOrigin;
+	bool coverageSaturated = false;
+
+public:
+	Rasterizer() {}
+	Rasterizer(uchar* data, int width, int height, int bytesPerLine) { setTarget(data, width, height, bytesPerLine); }
+	explicit Rasterizer(QImage& image) { setTarget(image.bits(), image.width(), image.height(), image.bytesPerLine()); }
+
+	void setTarget(uchar* targetData, int targetWidth, int targetHeight, int targetBytesPerLine);
+	void setClipRect(const QRect& rect) { clipRect = rect.intersected(QRect(0, 0, width, height)); }
+	QRect getClipRect() const { return clipRect; }
+
+	// Colors, blend mode and opacity used by the low-level functions below; the draw* functions load them themselves
+	void loadShapeStyle(const Shape& shape);
+
+	// Redirects drawing into a byte mask covering maskRect: fills add 0x10, border pixels add 0x01
+	void setCoverageTarget(uchar* mask, const QRect& maskRect);
+	// A count in the mask would have passed 15 and stopped there, so the mask no longer replays exactly
+	bool isCoverageSaturated() const { return coverageSaturated; }
+
+	bool isInside(QPoint point) { return (point.x() > 0 && point.y() > 0 && point.x() < width - 1 && point.y() < height - 1) ? true : false; }
+	bool isInside(int x, int y) { return (x > 0 && y > 0 && x < width && y < height) ? true : false; }
+
+	//Pixel and span functions
+	void blendPixelAt(int x, int y, QRgb packedColor);
+	void fillSpan(int y, int x0, int x1, QRgb packedColor);
+	void fillSpans(const std::vector<Span>& spans, QRgb packedColor);
+
+	//Draw functions
+	void drawShape(Shape& shape);
+
+	//	Lines
+	void drawLine(Line& line);
+	void drawLineBresenham(QVector<QPoint>& linePoints);
+	void drawLineBresenham(const QPoint& start, const QPoint& end);
+
+	//	Polylines
+	// Outlines count vertices (closed joins the last one back to the first); every pixel is plotted once
+	void drawPolyline(const QPoint* points, int count, bool closed);
+
+	//	Circles
+	void drawCircle(Circle& circle);
+	void drawSymmetricPoints(const QPoint& center, int x, int y);
+	void fillCircle(const QPoint& center, int r);
+
+	// Polygons
+	void drawPolygon(MyPolygon& polygon);
+
+	//  **Trimming functions**
+	QVector<QPoint> trimPolygon(Shape& polygon);
+
+	//	**Polygon filling handling**
+	void fillPolygon(Shape& polygon);
+
+	//	** Curve function declarations **
+	void drawCurve(BezierCurve& curve);
+	void setCurveTolerance(double pixels) { curveTolerance = qMax(pixels, 0.01); }
+
+	//	Rectangles
+	void drawRectangle(MyRectangle& rectangle);
+};
@@ -1,13 +1,37 @@
 #pragma once
 
 #include <QPoint>
+#include <QRect>
+#include <QTransform>
+#include <QVarLengthArray>
 #include <QVector>
 #include <memory>
+#include <cmath>
+#include <algorithm>
 #include <variant>
 
+// Read-only view of a shape's points in its own storage. Valid until the shape's geometry next changes.
+struct PointSpan {
+    const QPoint* data = nullptr;
+    int count = 0;
+
+    PointSpan() {}
+    PointSpan(const QPoint* data, int count) : data(data), count(count) {}
+
+    int size() const { return count; }
+    bool isEmpty() const { return count == 0; }
+    const QPoint& operator[](int i) const { return data[i]; }
+    const QPoint& first() const { return data[0]; }
+    const QPoint& last() const { return data[count - 1]; }
+    const QPoint* begin() const { return data; }
+    const QPoint* end() const { return data + count; }
+    QVector<QPoint> toVector() const { return QVector<QPoint>(begin(), end()); }
+};
+
 class Shape {
 public:
     enum ShapeType { LINE, RECTANGLE, POLYGON, CIRCLE, BEZIER_CURVE };
+    enum BlendMode { SOURCE_OVER, MULTIPLY, SCREEN, OVERLAY, ADDITIVE };
 
     Shape(ShapeType type, int zBufferPosition, bool isFilled, const QColor& borderColor, const QColor& fillingColor)
         : type(type), zBufferPosition(zBufferPosition), isFilled(isFilled), borderColor(borderColor), fillingColor(fillingColor) {}
@@ -19,133 +43,197 @@ public:
     bool getIsFilled() const { return isFilled; }
     QColor getBorderColor() const { return borderColor; }
     QColor getFillingColor() const { return fillingColor; }
+    double getOpacity() const { return opacity; }
+    BlendMode getBlendMode() const { return blendMode; }
 
     void setZBufferPosition(int zBufferPos) { zBufferPosition = zBufferPos; }
     void setBorderColor(const QColor& color) { borderColor = color; }
     void setFillingColor(const QColor& color) { fillingColor = color; }
-
-    virtual QVector<QPoint> getPoints() { return { QPoint(), QPoint() }; }
-    virtual void setPoints(const QVector<QPoint>& points) {}
+    void setOpacity(double value) { opacity = value < 0.0 ? 0.0 : (value > 1.0 ? 1.0 : value); }
+    void setBlendMode(BlendMode mode) { blendMode = mode; }
+
+    // Geometry is kept as floating point model points plus one accumulated affine transform. Edits only
+    // compose the transform, so the model is never rewritten and repeated rotations do not drift; the
+    // pixel positions everything else reads are re-derived from the model in one pass per edit.
+
+    // The pixel positions without copying them; prefer this over getPoints() wherever the points are only read
+    PointSpan pointSpan() const { return PointSpan(devicePoints.constData(), devicePoints.size()); }
+    QVector<QPoint> getPoints() const { return pointSpan().toVector(); }
+    // The points become the new model and the transform is reset
+    virtual void setPoints(const QVector<QPoint>& points) { assignPoints(points.constData(), points.size()); }
     virtual void addPoint(QPoint point) {}
 
+    const QTransform& getTransform() const { return transform; }
+    // Applies transform after the shape's current one
+    void applyTransform(const QTransform& next) {
+        transform *= next;
+        mapModelPoints();
+    }
+
+    // Pivot for rotation and scaling, at full precision
+    virtual QPointF getCenter() const {
+        if (modelPoints.isEmpty()) {
+            return QPointF();
+        }
+        QPointF sum;
+        for (const QPointF& point : modelPoints) {
+            sum += point;
+        }
+        // Affine maps preserve centroids, so the model centroid maps onto the drawn one
+        return transform.map(sum / modelPoints.size());
+    }
+
+    // Smallest rectangle containing every pixel the shape can touch
+    virtual QRect getBoundingRect() {
+        PointSpan points = pointSpan();
+        if (points.isEmpty()) {
+            return QRect();
+        }
+        int left = points[0].x(), right = left, top = points[0].y(), bottom = top;
+        for (const QPoint& point : points) {
+            left = std::min(left, point.x());
+            right = std::max(right, point.x());
+            top = std::min(top, point.y());
+            bottom = std::max(bottom, point.y());
+        }
+        return QRect(QPoint(left, top), QPoint(right, bottom));
+    }
+
 protected:
     ShapeType type;
     int zBufferPosition;
     bool isFilled;
     QColor borderColor;
     QColor fillingColor;
+    double opacity = 1.0;
+    BlendMode blendMode = SOURCE_OVER;
+
+    void assignPoints(const QPoint* points, int count) {
+        modelPoints.clear();
+        for (int i = 0; i < count; i++) {
+            modelPoints.append(QPointF(points[i]));
+        }
+        transform = QTransform();
+        mapModelPoints();
+    }
+
+    const QPointF& modelPoint(int index) const { return modelPoints[index]; }
+
+    // Points added to a transformed shape are taken back into model space first
+    void appendPoint(const QPoint& point) {
+        modelPoints.append(transform.isIdentity() ? QPointF(point) : transform.inverted().map(QPointF(point)));
+        mapModelPoints();
+    }
+
+private:
+    // Most shapes have at most four points, which then live inside the shape instead of on the heap
+    QVarLengthArray<QPointF, 4> modelPoints;
+    QVarLengthArray<QPoint, 4> devicePoints;
+    QTransform transform;
+
+    // The whole transform in one branch-free pass over contiguous points, which the compiler vectorizes.
+    // Rounding is half up, the same for every point, so shared vertices of adjacent shapes stay shared.
+    void mapModelPoints() {
+        const int count = modelPoints.size();
+        devicePoints.resize(count);
+        const qreal m11 = transform.m11(), m12 = transform.m12(), m21 = transform.m21(), m22 = transform.m22();
+        const qreal dx = transform.dx(), dy = transform.dy();
+        const QPointF* model = modelPoints.constData();
+        QPoint* device = devicePoints.data();
+        for (int i = 0; i < count; i++) {
+            const qreal x = model[i].x(), y = model[i].y();
+            device[i] = QPoint(static_cast<int>(std::floor(m11 * x + m21 * y + dx + 0.5)), static_cast<int>(std::floor(m12 * x + m22 * y + dy + 0.5)));
+        }
+    }
 };
 
 class Line : public Shape {
 public:
     Line(const QPoint& p1, const QPoint& p2, int zBufferPosition, bool isFilled, const QColor& borderColor, const QColor& fillingColor)
-        : Shape(Shape::LINE, zBufferPosition, isFilled, borderColor, fillingColor), p1(p1), p2(p2) {}
+        : Shape(Shape::LINE, zBufferPosition, isFilled, borderColor, fillingColor) {
+        const QPoint ends[] = { p1, p2 };
+        assignPoints(ends, 2);
+    }
 
     ~Line() override {}
 
-    QVector<QPoint> getPoints() override {
-        return { p1, p2 };
-    }
-
     void setPoints(const QVector<QPoint>& points) override {
         if (points.size() >= 2) {
-            p1 = points[0];
-            p2 = points[1];
+            assignPoints(points.constData(), 2);
         }
     }
-
-private:
-    QPoint p1, p2;
 };
 
 class MyRectangle : public Shape {
 public:
     MyRectangle(const QPoint& p1, const QPoint& p2, const QPoint& p3, const QPoint& p4, int zBufferPosition, bool isFilled, const QColor& borderColor, const QColor& fillingColor)
-        : Shape(Shape::RECTANGLE, zBufferPosition, isFilled, borderColor, fillingColor), p1(p1), p2(p2), p3(p3), p4(p4) {}
+        : Shape(Shape::RECTANGLE, zBufferPosition, isFilled, borderColor, fillingColor) {
+        const QPoint corners[] = { p1, p2, p3, p4 };
+        assignPoints(corners, 4);
+    }
 
     ~MyRectangle() override {}
 
-    QVector<QPoint> getPoints() override {
-        return { p1, p2, p3, p4 };
-    }
-
     void setPoints(const QVector<QPoint>& points) override {
-        if (points.size() >= 2) {
-            p1 = points[0];
-            p2 = points[1];
-            p3 = points[2];
-            p4 = points[3];
+        if (points.size() >= 4) {
+            assignPoints(points.constData(), 4);
         }
     }
-
-private:
-    QPoint p1, p2, p3, p4;
 };
 
 class MyPolygon : public Shape {
 public:
     MyPolygon(const QVector<QPoint>& points, int zBufferPosition, bool isFilled, const QColor& borderColor, const QColor& fillingColor)
-        : Shape(Shape::POLYGON, zBufferPosition, isFilled, borderColor, fillingColor), points(points) {}
-
-    ~MyPolygon() override {}
-
-    QVector<QPoint> getPoints() override {
-        return points;
+        : Shape(Shape::POLYGON, zBufferPosition, isFilled, borderColor, fillingColor) {
+        assignPoints(points.constData(), points.size());
     }
 
-    void setPoints(const QVector<QPoint>& newPoints) override {
-        points = newPoints;
-    }
+    ~MyPolygon() override {}
 
     void addPoint(QPoint point) override {
-        points.append(point);
+        appendPoint(point);
     }
-
-private:
-    QVector<QPoint> points;
 };
 
 class Circle : public Shape {
 public:
     Circle(const QPoint& center, const QPoint& edge, int zBufferPosition, bool isFilled, const QColor& borderColor, const QColor& fillingColor)
-        : Shape(Shape::CIRCLE, zBufferPosition, isFilled, borderColor, fillingColor), center(center), edge(edge) {}
+        : Shape(Shape::CIRCLE, zBufferPosition, isFilled, borderColor, fillingColor) {
+        const QPoint centerAndEdge[] = { center, edge };
+        assignPoints(centerAndEdge, 2);
+    }
 
     ~Circle() override {}
 
-    QVector<QPoint> getPoints() override {
-        return { center, edge };
-    }
-
     void setPoints(const QVector<QPoint>& points) override {
         if (points.size() >= 2) {
-            center = points[0];
-            edge = points[1];
+            assignPoints(points.constData(), 2);
         }
     }
 
-private:
-    QPoint center, edge;
+    QPointF getCenter() const override {
+        return getTransform().map(modelPoint(0));
+    }
+
+    QRect getBoundingRect() override {
+        PointSpan points = pointSpan();
+        const QPoint& center = points[0];
+        const QPoint& edge = points[1];
+        int r = std::sqrt(std::pow(edge.x() - center.x(), 2) + std::pow(edge.y() - center.y(), 2));
+        return QRect(center.x() - r, center.y() - r, 2 * r + 1, 2 * r + 1);
+    }
 };
 
 class BezierCurve : public Shape {
 public:
     BezierCurve(const QVector<QPoint>& controlPoints, int zBufferPosition, bool isFilled, const QColor& borderColor, const QColor& fillingColor)
-        : Shape(Shape::BEZIER_CURVE, zBufferPosition, isFilled, borderColor, fillingColor), controlPoints(controlPoints) {}
-
-    ~BezierCurve() override {}
-
-    QVector<QPoint> getPoints() override {
-        return controlPoints;
+        : Shape(Shape::BEZIER_CURVE, zBufferPosition, isFilled, borderColor, fillingColor) {
+        assignPoints(controlPoints.constData(), controlPoints.size());
     }
 
-    void setPoints(const QVector<QPoint>& points) override {
-        controlPoints = points;
-    }
+    ~BezierCurve() override {}
 
     void addPoint(QPoint point) override {
-        controlPoints.append(point);
+        appendPoint(point);
     }
-
-private:
-    QVector<QPoint> controlPoints;
-};
\ No newline at end of file
+};
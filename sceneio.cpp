@@ -0,0 +1,794 @@
+#include "sceneio.h"
+#include "instrumentation.h"
+#include <QColor>
+#include <QFile>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <memory>
+
+Shape* createSceneShape(Shape::ShapeType type, PointSpan points, int zBufferPosition, bool isFilled, const QColor& borderColor, const QColor& fillingColor, ShapePool& pool)
+{
+	switch (type) {
+	case Shape::LINE:
+		return points.size() == 2 ? pool.create<Line>(points[0], points[1], zBufferPosition, isFilled, borderColor, fillingColor) : nullptr;
+	case Shape::RECTANGLE:
+		return points.size() == 4 ? pool.create<MyRectangle>(points[0], points[1], points[2], points[3], zBufferPosition, isFilled, borderColor, fillingColor) : nullptr;
+	case Shape::POLYGON:
+		return points.size() >= 3 ? pool.create<MyPolygon>(points.toVector(), zBufferPosition, isFilled, borderColor, fillingColor) : nullptr;
+	case Shape::CIRCLE:
+		return points.size() == 2 ? pool.create<Circle>(points[0], points[1], zBufferPosition, isFilled, borderColor, fillingColor) : nullptr;
+	case Shape::BEZIER_CURVE:
+		return points.size() >= 3 ? pool.create<BezierCurve>(points.toVector(), zBufferPosition, isFilled, borderColor, fillingColor) : nullptr;
+	}
+	return nullptr;
+}
+
+//-----------------------------------------
+//		*** CSV parsing ***
+//-----------------------------------------
+// The file is mapped and cut into line-aligned chunks that are parsed in parallel, straight from the
+// bytes: fields are located by their commas and numbers and #rgb, #rrggbb and #aarrggbb colors are
+// decoded by hand, so a row costs no allocation. Rows keep the rules of the QString based reader the
+// format came with: fewer than six fields stop the parse, integers that do not parse read as 0, and
+// point pairs other than two comma separated values are dropped. Shapes are created afterwards in
+// file order, as the pool belongs to one thread.
+
+namespace {
+
+const qint64 minCsvChunkBytes = 1 << 20;
+
+struct CsvRow {
+	int line;					// Within the chunk, from 0
+	bool knownType;
+	Shape::ShapeType type;
+	int zBufferPosition;
+	bool isFilled;
+	QColor borderColor;
+	QColor fillingColor;
+	quint32 firstPoint;
+	quint32 pointCount;
+};
+
+struct CsvChunk {
+	const char* begin;
+	const char* end;
+	std::vector<CsvRow> rows;
+	std::vector<QPoint> points;
+	int lines = 0;
+	int formatErrorLine = -1;	// Within the chunk; rows from here on are not read
+};
+
+inline bool isCsvSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+}
+
+// As QString::toInt: surrounding whitespace is allowed, anything else that is not a number reads as 0.
+// Parentheses are skipped wherever they are, as the old reader removed them before converting.
+int parseCsvInt(const char* begin, const char* end)
+{
+	auto skip = [&](const char* p) {
+		while (p < end && (*p == '(' || *p == ')')) {
+			p++;
+		}
+		return p;
+	};
+	const char* p = skip(begin);
+	while (p < end && isCsvSpace(*p)) {
+		p = skip(p + 1);
+	}
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = *p == '-';
+		p = skip(p + 1);
+	}
+
+	qint64 value = 0;
+	int digits = 0;
+	while (p < end && *p >= '0' && *p <= '9') {
+		value = value * 10 + (*p - '0');
+		if (value > static_cast<qint64>(std::numeric_limits<int>::max()) + 1) {
+			return 0;
+		}
+		digits++;
+		p = skip(p + 1);
+	}
+	while (p < end && isCsvSpace(*p)) {
+		p = skip(p + 1);
+	}
+	if (digits == 0 || p != end) {
+		return 0;
+	}
+	value = negative ? -value : value;
+	return value > std::numeric_limits<int>::max() ? 0 : static_cast<int>(value);
+}
+
+inline int hexDigit(char c)
+{
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	}
+	if (c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
+	}
+	if (c >= 'A' && c <= 'F') {
+		return c - 'A' + 10;
+	}
+	return -1;
+}
+
+// The names saveCurrentImageState writes are decoded here; anything else goes through QColor's own parser
+QColor parseCsvColor(const char* begin, const char* end)
+{
+	const qint64 length = end - begin;
+	if (length > 0 && begin[0] == '#' && (length == 4 || length == 7 || length == 9)) {
+		quint32 value = 0;
+		bool valid = true;
+		for (const char* p = begin + 1; p < end; p++) {
+			int digit = hexDigit(*p);
+			valid = valid && digit >= 0;
+			value = (value << 4) | static_cast<quint32>(digit & 0xf);
+		}
+		if (valid) {
+			if (length == 4) {
+				return QColor(((value >> 8) & 0xf) * 0x11, ((value >> 4) & 0xf) * 0x11, (value & 0xf) * 0x11);
+			}
+			if (length == 7) {
+				return QColor((value >> 16) & 0xff, (value >> 8) & 0xff, value & 0xff);
+			}
+			return QColor::fromRgba(value);
+		}
+	}
+	return QColor(QString::fromLatin1(begin, static_cast<int>(length)));
+}
+
+bool parseCsvType(const char* begin, const char* end, Shape::ShapeType& type)
+{
+	static const struct { const char* name; Shape::ShapeType type; } names[] = {
+		{ "Line", Shape::LINE }, { "Rectangle", Shape::RECTANGLE }, { "Polygon", Shape::POLYGON },
+		{ "Circle", Shape::CIRCLE }, { "BezierCurve", Shape::BEZIER_CURVE }
+	};
+	const size_t length = static_cast<size_t>(end - begin);
+	for (const auto& entry : names) {
+		if (std::strlen(entry.name) == length && std::memcmp(entry.name, begin, length) == 0) {
+			type = entry.type;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Returns false for a line with fewer than six fields
+bool parseCsvRow(const char* begin, const char* end, CsvChunk& chunk, CsvRow& row)
+{
+	const char* fields[6];
+	const char* p = begin;
+	for (int field = 0; field < 5; field++) {
+		fields[field] = p;
+		p = static_cast<const char*>(std::memchr(p, ',', static_cast<size_t>(end - p)));
+		if (!p) {
+			return false;
+		}
+		p++;
+	}
+	fields[5] = p;
+	auto fieldEnd = [&](int field) { return fields[field + 1] - 1; };
+
+	row.knownType = parseCsvType(fields[0], fieldEnd(0), row.type);
+	row.zBufferPosition = parseCsvInt(fields[1], fieldEnd(1));
+	row.isFilled = fieldEnd(2) - fields[2] == 4 && std::memcmp(fields[2], "true", 4) == 0;
+	row.borderColor = parseCsvColor(fields[3], fieldEnd(3));
+	row.fillingColor = parseCsvColor(fields[4], fieldEnd(4));
+
+	// The rest of the line, commas included, is a space separated list of "(x,y)" pairs
+	row.firstPoint = static_cast<quint32>(chunk.points.size());
+	for (p = fields[5]; p < end;) {
+		if (*p == ' ') {
+			p++;
+			continue;
+		}
+		const char* token = p;
+		while (p < end && *p != ' ') {
+			p++;
+		}
+		const char* comma = static_cast<const char*>(std::memchr(token, ',', static_cast<size_t>(p - token)));
+		if (comma && !std::memchr(comma + 1, ',', static_cast<size_t>(p - comma - 1))) {
+			chunk.points.push_back(QPoint(parseCsvInt(token, comma), parseCsvInt(comma + 1, p)));
+		}
+	}
+	row.pointCount = static_cast<quint32>(chunk.points.size()) - row.firstPoint;
+	return true;
+}
+
+void parseCsvChunk(CsvChunk& chunk)
+{
+	INSTRUMENT_SCOPE("loadSceneCsv::chunk");
+	chunk.rows.reserve(static_cast<size_t>((chunk.end - chunk.begin) / 48));
+	chunk.points.reserve(static_cast<size_t>((chunk.end - chunk.begin) / 12));
+	for (const char* line = chunk.begin; line < chunk.end; chunk.lines++) {
+		const char* next = static_cast<const char*>(std::memchr(line, '\n', static_cast<size_t>(chunk.end - line)));
+		const char* end = next ? next : chunk.end;
+		const char* content = end > line && end[-1] == '\r' ? end - 1 : end;
+
+		CsvRow row;
+		row.line = chunk.lines;
+		if (!parseCsvRow(line, content, chunk, row)) {
+			chunk.formatErrorLine = chunk.lines;
+			return;
+		}
+		chunk.rows.push_back(row);
+		line = next ? next + 1 : chunk.end;
+	}
+}
+
+class CsvChunkJob : public QRunnable {
+public:
+	explicit CsvChunkJob(CsvChunk& chunk) : chunk(chunk) { setAutoDelete(false); }
+	void run() override { parseCsvChunk(chunk); }
+
+private:
+	CsvChunk& chunk;
+};
+
+}
+
+bool loadSceneCsv(const QString& filePath, SceneFile& scene, ShapePool& pool)
+{
+	INSTRUMENT_SCOPE("loadSceneCsv");
+	QFile file(filePath);
+	if (!file.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+
+	// Mapped where possible; a file that cannot be mapped is read into memory instead
+	const qint64 size = file.size();
+	QByteArray contents;
+	const char* data = size > 0 ? reinterpret_cast<const char*>(file.map(0, size)) : nullptr;
+	qint64 length = size;
+	if (!data && size > 0) {
+		contents = file.readAll();
+		// A file that had bytes a moment ago and reads back empty failed to read
+		if (contents.isEmpty()) {
+			return false;
+		}
+		data = contents.constData();
+		length = contents.size();
+	}
+	const char* end = data ? data + length : nullptr;
+
+	// The header line is skipped
+	const char* body = data ? static_cast<const char*>(std::memchr(data, '\n', static_cast<size_t>(end - data))) : nullptr;
+	body = body ? body + 1 : end;
+
+	// Line-aligned chunks, one per core once the file is large enough to be worth splitting
+	const qint64 bodyBytes = end - body;
+	const int chunkCount = static_cast<int>(std::max<qint64>(1, std::min<qint64>(QThread::idealThreadCount(), bodyBytes / minCsvChunkBytes)));
+	std::vector<CsvChunk> chunks(chunkCount);
+	const char* from = body;
+	for (int i = 0; i < chunkCount; i++) {
+		const char* to = i + 1 == chunkCount ? end : std::max(from, body + bodyBytes * (i + 1) / chunkCount);
+		const char* lineEnd = to < end ? static_cast<const char*>(std::memchr(to, '\n', static_cast<size_t>(end - to))) : nullptr;
+		to = i + 1 == chunkCount || !lineEnd ? end : lineEnd + 1;
+		chunks[i].begin = from;
+		chunks[i].end = to;
+		from = to;
+	}
+
+	if (chunkCount == 1) {
+		parseCsvChunk(chunks[0]);
+	}
+	else {
+		QThreadPool workers;
+		workers.setMaxThreadCount(chunkCount);
+		std::vector<std::unique_ptr<CsvChunkJob>> jobs;
+		for (CsvChunk& chunk : chunks) {
+			jobs.emplace_back(new CsvChunkJob(chunk));
+			workers.start(jobs.back().get());
+		}
+		workers.waitForDone();
+	}
+
+	// In file order, up to the first line that stopped a chunk; line numbers count the header as line 1
+	int firstLine = 2;
+	for (CsvChunk& chunk : chunks) {
+		for (const CsvRow& row : chunk.rows) {
+			Shape* shape = nullptr;
+			if (row.knownType) {
+				shape = createSceneShape(row.type, PointSpan(chunk.points.data() + row.firstPoint, static_cast<int>(row.pointCount)),
+					row.zBufferPosition, row.isFilled, row.borderColor, row.fillingColor, pool);
+			}
+			if (!shape) {
+				if (scene.invalidShapes++ == 0) {
+					scene.firstInvalidLine = firstLine + row.line;
+				}
+				continue;
+			}
+			scene.shapes.push_back(std::make_pair(shape, row.zBufferPosition));
+		}
+		if (chunk.formatErrorLine >= 0) {
+			scene.formatError = true;
+			scene.formatErrorLine = firstLine + chunk.formatErrorLine;
+			break;
+		}
+		firstLine += chunk.lines;
+	}
+
+	if (!contents.isEmpty() || !data) {
+		return true;
+	}
+	file.unmap(reinterpret_cast<uchar*>(const_cast<char*>(data)));
+	return true;
+}
+
+QString shapeTypeName(Shape::ShapeType type)
+{
+	switch (type) {
+	case Shape::LINE:
+		return "Line";
+	case Shape::RECTANGLE:
+		return "Rectangle";
+	case Shape::POLYGON:
+		return "Polygon";
+	case Shape::CIRCLE:
+		return "Circle";
+	case Shape::BEZIER_CURVE:
+		return "BezierCurve";
+	}
+	return QString();
+}
+
+bool loadScene(const QString& filePath, SceneFile& scene, ShapePool& pool, const QRect& region)
+{
+	if (SceneMap::isBinaryScene(filePath)) {
+		return loadSceneBinary(filePath, scene, pool, region);
+	}
+	return loadSceneCsv(filePath, scene, pool);
+}
+
+//-----------------------------------------
+//		*** Binary scenes ***
+//-----------------------------------------
+
+namespace {
+
+const char binaryMagic[8] = { 'I', 'V', 'S', 'C', 'E', 'N', 'E', '\0' };
+const quint32 binaryVersion = 1;
+// As in SpatialIndex: a shape spanning more cells goes to the list every query scans
+const int maxCellsPerShape = 256;
+// Compressed blocks are closed at the first shape boundary past this many points
+const quint64 pointsPerBlock = 65536;
+
+static_assert(sizeof(QPoint) == 2 * sizeof(qint32), "Coordinates are mapped as QPoint");
+static_assert(sizeof(SceneBinaryHeader) == 88 && sizeof(SceneBinaryRecord) == 48 && sizeof(SceneBinaryBlock) == 24, "Binary scene layout changed");
+
+bool writePadded(QFile& file, const void* data, qint64 bytes)
+{
+	static const char zeros[8] = {};
+	if (bytes > 0 && file.write(static_cast<const char*>(data), bytes) != bytes) {
+		return false;
+	}
+	qint64 padding = (8 - file.pos() % 8) % 8;
+	return padding == 0 || file.write(zeros, padding) == padding;
+}
+
+}
+
+bool saveSceneBinary(const QString& filePath, const std::vector<std::pair<Shape*, int>>& shapes, bool compressPoints)
+{
+	QFile file(filePath);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		return false;
+	}
+
+	SceneBinaryHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, binaryMagic, sizeof(binaryMagic));
+	header.version = binaryVersion;
+	header.flags = compressPoints ? SceneBinaryHeader::CompressedPoints : 0;
+	header.shapeCount = shapes.size();
+
+	std::vector<SceneBinaryRecord> table(shapes.size());
+	QRect extent;
+	for (size_t i = 0; i < shapes.size(); i++) {
+		Shape& shape = *shapes[i].first;
+		QRect bounds = shape.getBoundingRect();
+		SceneBinaryRecord& record = table[i];
+		std::memset(&record, 0, sizeof(record));
+		record.firstPoint = header.pointCount;
+		record.type = static_cast<quint8>(shape.getType());
+		record.isFilled = shape.getIsFilled() ? 1 : 0;
+		record.blendMode = static_cast<quint8>(shape.getBlendMode());
+		record.zBufferPosition = shapes[i].second;
+		record.borderColor = shape.getBorderColor().rgba();
+		record.fillingColor = shape.getFillingColor().rgba();
+		record.opacity = static_cast<float>(shape.getOpacity());
+		record.pointCount = static_cast<quint32>(shape.pointSpan().size());
+		record.bounds[0] = bounds.left();
+		record.bounds[1] = bounds.top();
+		record.bounds[2] = bounds.right();
+		record.bounds[3] = bounds.bottom();
+		header.pointCount += record.pointCount;
+		extent |= bounds;
+	}
+
+	// The header is written last, once every offset is known
+	if (!writePadded(file, &header, sizeof(header))) {
+		return false;
+	}
+	header.shapeTableOffset = file.pos();
+	if (!writePadded(file, table.data(), static_cast<qint64>(table.size() * sizeof(SceneBinaryRecord)))) {
+		return false;
+	}
+
+	if (!compressPoints) {
+		header.pointsOffset = file.pos();
+		for (const auto& entry : shapes) {
+			PointSpan points = entry.first->pointSpan();
+			qint64 bytes = static_cast<qint64>(points.size()) * sizeof(QPoint);
+			if (bytes > 0 && file.write(reinterpret_cast<const char*>(points.data), bytes) != bytes) {
+				return false;
+			}
+		}
+		if (!writePadded(file, nullptr, 0)) {
+			return false;
+		}
+	}
+	else {
+		// Blocks hold whole shapes, so a shape's points are always inflated in one piece
+		std::vector<SceneBinaryBlock> blocks;
+		QByteArray pending;
+		SceneBinaryBlock block = { 0, 0, 0, 0 };
+		auto flush = [&]() {
+			QByteArray compressed = qCompress(pending);
+			block.offset = file.pos();
+			block.compressedBytes = static_cast<quint32>(compressed.size());
+			blocks.push_back(block);
+			block.firstPoint += block.pointCount;
+			block.pointCount = 0;
+			pending.clear();
+			return writePadded(file, compressed.constData(), compressed.size());
+		};
+		for (const auto& entry : shapes) {
+			PointSpan points = entry.first->pointSpan();
+			pending.append(reinterpret_cast<const char*>(points.data), static_cast<int>(points.size() * sizeof(QPoint)));
+			block.pointCount += points.size();
+			if (block.pointCount >= pointsPerBlock && !flush()) {
+				return false;
+			}
+		}
+		if (block.pointCount > 0 && !flush()) {
+			return false;
+		}
+		header.pointsOffset = file.pos();
+		header.blockCount = blocks.size();
+		if (!writePadded(file, blocks.data(), static_cast<qint64>(blocks.size() * sizeof(SceneBinaryBlock)))) {
+			return false;
+		}
+	}
+
+	// Spatial index: the grid gets coarser until it has no more cells than shapes (and at least a few thousand)
+	quint32 cellShift = 6;
+	qint64 columns = 0, rows = 0;
+	const qint64 maxCells = std::max<qint64>(4096, static_cast<qint64>(shapes.size()));
+	if (!extent.isEmpty()) {
+		for (;; cellShift++) {
+			columns = ((static_cast<qint64>(extent.right()) - extent.left()) >> cellShift) + 1;
+			rows = ((static_cast<qint64>(extent.bottom()) - extent.top()) >> cellShift) + 1;
+			if (columns * rows <= maxCells || cellShift >= 30) {
+				break;
+			}
+		}
+	}
+	header.indexLeft = extent.left();
+	header.indexTop = extent.top();
+	header.indexColumns = static_cast<qint32>(columns);
+	header.indexRows = static_cast<qint32>(rows);
+	header.indexCellShift = cellShift;
+
+	// Counted first, then filled, so every cell's entries end up contiguous and in painter's order
+	const qint64 cells = columns * rows;
+	std::vector<quint64> cellStarts(static_cast<size_t>(cells) + 2, 0);
+	auto forEachCell = [&](const SceneBinaryRecord& record, const std::function<void(qint64)>& visit) {
+		qint64 firstColumn = (static_cast<qint64>(record.bounds[0]) - extent.left()) >> cellShift;
+		qint64 lastColumn = (static_cast<qint64>(record.bounds[2]) - extent.left()) >> cellShift;
+		qint64 firstRow = (static_cast<qint64>(record.bounds[1]) - extent.top()) >> cellShift;
+		qint64 lastRow = (static_cast<qint64>(record.bounds[3]) - extent.top()) >> cellShift;
+		if ((lastColumn - firstColumn + 1) * (lastRow - firstRow + 1) > maxCellsPerShape) {
+			visit(cells);
+			return;
+		}
+		for (qint64 row = firstRow; row <= lastRow; row++) {
+			for (qint64 column = firstColumn; column <= lastColumn; column++) {
+				visit(row * columns + column);
+			}
+		}
+	};
+	for (const SceneBinaryRecord& record : table) {
+		forEachCell(record, [&](qint64 cell) { cellStarts[cell + 1]++; });
+	}
+	for (size_t i = 1; i < cellStarts.size(); i++) {
+		cellStarts[i] += cellStarts[i - 1];
+	}
+	std::vector<quint32> entries(cellStarts.back());
+	std::vector<quint64> cursors(cellStarts.begin(), cellStarts.end() - 1);
+	for (size_t i = 0; i < table.size(); i++) {
+		forEachCell(table[i], [&](qint64 cell) { entries[cursors[cell]++] = static_cast<quint32>(i); });
+	}
+
+	header.indexOffset = file.pos();
+	if (!writePadded(file, cellStarts.data(), static_cast<qint64>(cellStarts.size() * sizeof(quint64)))
+		|| !writePadded(file, entries.data(), static_cast<qint64>(entries.size() * sizeof(quint32)))) {
+		return false;
+	}
+
+	if (!file.seek(0) || file.write(reinterpret_cast<const char*>(&header), sizeof(header)) != sizeof(header)) {
+		return false;
+	}
+	file.close();
+	return true;
+}
+
+bool loadSceneBinary(const QString& filePath, SceneFile& scene, ShapePool& pool, const QRect& region)
+{
+	SceneMap map;
+	if (!map.open(filePath)) {
+		if (map.hasFormatError()) {
+			scene.formatError = true;
+			return true;
+		}
+		return false;
+	}
+
+	auto load = [&](int index) {
+		Shape* shape = map.createShape(index, pool);
+		if (!shape) {
+			scene.invalidShapes++;
+			return;
+		}
+		scene.shapes.push_back(std::make_pair(shape, map.record(index).zBufferPosition));
+	};
+
+	if (region.isNull()) {
+		scene.shapes.reserve(map.shapeCount());
+		for (int index = 0; index < map.shapeCount(); index++) {
+			load(index);
+		}
+	}
+	else {
+		// One pixel of slack, as the renderer bins shapes
+		std::vector<int> indices;
+		map.query(region.adjusted(-1, -1, 1, 1), indices);
+		scene.shapes.reserve(indices.size());
+		for (int index : indices) {
+			load(index);
+		}
+	}
+	return true;
+}
+
+//-----------------------------------------
+//		*** Scene map ***
+//-----------------------------------------
+
+bool SceneMap::open(const QString& filePath)
+{
+	close();
+	formatError = false;
+
+	file.setFileName(filePath);
+	if (!file.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+	fileSize = file.size();
+	if (fileSize < static_cast<qint64>(sizeof(SceneBinaryHeader))) {
+		formatError = true;
+		close();
+		return false;
+	}
+	base = file.map(0, fileSize);
+	if (!base) {
+		close();
+		return false;
+	}
+	if (!validate()) {
+		formatError = true;
+		close();
+		return false;
+	}
+	return true;
+}
+
+void SceneMap::close()
+{
+	if (base) {
+		file.unmap(const_cast<uchar*>(base));
+	}
+	file.close();
+	base = nullptr;
+	fileSize = 0;
+	header = nullptr;
+	records = nullptr;
+	coordinates = nullptr;
+	blocks = nullptr;
+	inflated.clear();
+	cellStarts = nullptr;
+	cellEntries = nullptr;
+	entryCount = 0;
+}
+
+// Checks every offset and count the accessors rely on, so a damaged file cannot make them read outside the mapping
+bool SceneMap::validate()
+{
+	const quint64 size = static_cast<quint64>(fileSize);
+	auto fits = [size](quint64 offset, quint64 count, quint64 itemBytes) {
+		return offset % 8 == 0 && offset <= size && count <= (size - offset) / itemBytes;
+	};
+
+	const SceneBinaryHeader* candidate = reinterpret_cast<const SceneBinaryHeader*>(base);
+	if (std::memcmp(candidate->magic, binaryMagic, sizeof(binaryMagic)) != 0 || candidate->version != binaryVersion) {
+		return false;
+	}
+	if (candidate->shapeCount > static_cast<quint64>(std::numeric_limits<int>::max())
+		|| !fits(candidate->shapeTableOffset, candidate->shapeCount, sizeof(SceneBinaryRecord))) {
+		return false;
+	}
+
+	if (candidate->flags & SceneBinaryHeader::CompressedPoints) {
+		if (!fits(candidate->pointsOffset, candidate->blockCount, sizeof(SceneBinaryBlock))) {
+			return false;
+		}
+		const SceneBinaryBlock* table = reinterpret_cast<const SceneBinaryBlock*>(base + candidate->pointsOffset);
+		quint64 expected = 0;
+		for (quint64 i = 0; i < candidate->blockCount; i++) {
+			const SceneBinaryBlock& block = table[i];
+			if (block.firstPoint != expected || block.compressedBytes > static_cast<quint32>(std::numeric_limits<int>::max())
+				|| block.offset > size || block.compressedBytes > size - block.offset) {
+				return false;
+			}
+			expected += block.pointCount;
+		}
+		if (expected != candidate->pointCount) {
+			return false;
+		}
+		blocks = table;
+		inflated.resize(candidate->blockCount);
+	}
+	else {
+		if (!fits(candidate->pointsOffset, candidate->pointCount, sizeof(QPoint))) {
+			return false;
+		}
+		coordinates = reinterpret_cast<const QPoint*>(base + candidate->pointsOffset);
+	}
+
+	if (candidate->indexColumns < 0 || candidate->indexRows < 0 || candidate->indexCellShift > 30) {
+		return false;
+	}
+	const quint64 cells = static_cast<quint64>(candidate->indexColumns) * candidate->indexRows;
+	if (!fits(candidate->indexOffset, cells + 2, sizeof(quint64))) {
+		return false;
+	}
+	const quint64* starts = reinterpret_cast<const quint64*>(base + candidate->indexOffset);
+	for (quint64 cell = 0; cell <= cells; cell++) {
+		if (starts[cell] > starts[cell + 1]) {
+			return false;
+		}
+	}
+	const quint64 entriesOffset = candidate->indexOffset + (cells + 2) * sizeof(quint64);
+	if (starts[0] != 0 || !fits(entriesOffset, starts[cells + 1], sizeof(quint32))) {
+		return false;
+	}
+
+	header = candidate;
+	records = reinterpret_cast<const SceneBinaryRecord*>(base + candidate->shapeTableOffset);
+	cellStarts = starts;
+	cellEntries = reinterpret_cast<const quint32*>(base + entriesOffset);
+	entryCount = starts[cells + 1];
+	return true;
+}
+
+QRect SceneMap::bounds(int index) const
+{
+	const SceneBinaryRecord& record = records[index];
+	return QRect(QPoint(record.bounds[0], record.bounds[1]), QPoint(record.bounds[2], record.bounds[3]));
+}
+
+int SceneMap::blockOf(quint64 point) const
+{
+	const SceneBinaryBlock* end = blocks + header->blockCount;
+	const SceneBinaryBlock* found = std::upper_bound(blocks, end, point,
+		[](quint64 value, const SceneBinaryBlock& block) { return value < block.firstPoint; });
+	return static_cast<int>(found - blocks) - 1;
+}
+
+PointSpan SceneMap::points(int index)
+{
+	const SceneBinaryRecord& record = records[index];
+	if (record.pointCount == 0 || record.firstPoint > header->pointCount || record.pointCount > header->pointCount - record.firstPoint) {
+		return PointSpan();
+	}
+	if (coordinates) {
+		return PointSpan(coordinates + record.firstPoint, static_cast<int>(record.pointCount));
+	}
+
+	int blockIndex = blockOf(record.firstPoint);
+	if (blockIndex < 0) {
+		return PointSpan();
+	}
+	const SceneBinaryBlock& block = blocks[blockIndex];
+	if (record.firstPoint + record.pointCount > block.firstPoint + block.pointCount) {
+		return PointSpan();
+	}
+	QByteArray& data = inflated[blockIndex];
+	if (data.isEmpty()) {
+		data = qUncompress(base + block.offset, static_cast<int>(block.compressedBytes));
+		if (static_cast<quint64>(data.size()) != static_cast<quint64>(block.pointCount) * sizeof(QPoint)) {
+			data.clear();
+			return PointSpan();
+		}
+	}
+	return PointSpan(reinterpret_cast<const QPoint*>(data.constData()) + (record.firstPoint - block.firstPoint), static_cast<int>(record.pointCount));
+}
+
+void SceneMap::query(const QRect& rect, std::vector<int>& result) const
+{
+	result.clear();
+	if (rect.isEmpty()) {
+		return;
+	}
+
+	const qint64 columns = header->indexColumns;
+	const qint64 rows = header->indexRows;
+	const int shift = static_cast<int>(header->indexCellShift);
+	auto visit = [&](qint64 cell) {
+		for (quint64 k = cellStarts[cell]; k < cellStarts[cell + 1]; k++) {
+			quint32 index = cellEntries[k];
+			if (index < header->shapeCount && bounds(static_cast<int>(index)).intersects(rect)) {
+				result.push_back(static_cast<int>(index));
+			}
+		}
+	};
+
+	qint64 firstColumn = std::max<qint64>(0, (static_cast<qint64>(rect.left()) - header->indexLeft) >> shift);
+	qint64 lastColumn = std::min<qint64>(columns - 1, (static_cast<qint64>(rect.right()) - header->indexLeft) >> shift);
+	qint64 firstRow = std::max<qint64>(0, (static_cast<qint64>(rect.top()) - header->indexTop) >> shift);
+	qint64 lastRow = std::min<qint64>(rows - 1, (static_cast<qint64>(rect.bottom()) - header->indexTop) >> shift);
+	for (qint64 row = firstRow; row <= lastRow; row++) {
+		for (qint64 column = firstColumn; column <= lastColumn; column++) {
+			visit(row * columns + column);
+		}
+	}
+	visit(columns * rows);
+
+	// A shape touching several cells was found once per cell; table order is painter's order
+	std::sort(result.begin(), result.end());
+	result.erase(std::unique(result.begin(), result.end()), result.end());
+}
+
+Shape* SceneMap::createShape(int index, ShapePool& pool)
+{
+	const SceneBinaryRecord& record = records[index];
+	if (record.type > Shape::BEZIER_CURVE) {
+		return nullptr;
+	}
+	Shape* shape = createSceneShape(static_cast<Shape::ShapeType>(record.type), points(index), record.zBufferPosition, record.isFilled != 0,
+		QColor::fromRgba(record.borderColor), QColor::fromRgba(record.fillingColor), pool);
+	if (shape) {
+		shape->setOpacity(std::isnan(record.opacity) ? 1.0 : record.opacity);
+		shape->setBlendMode(record.blendMode <= Shape::ADDITIVE ? static_cast<Shape::BlendMode>(record.blendMode) : Shape::SOURCE_OVER);
+	}
+	return shape;
+}
+
+bool SceneMap::isBinaryScene(const QString& filePath)
+{
+	QFile file(filePath);
+	char magic[sizeof(binaryMagic)];
+	return file.open(QIODevice::ReadOnly) && file.read(magic, sizeof(magic)) == sizeof(magic)
+		&& std::memcmp(magic, binaryMagic, sizeof(magic)) == 0;
+}
@@ -0,0 +1,143 @@
+#pragma once
+#include <QByteArray>
+#include <QFile>
+#include <QRect>
+#include <QString>
+#include <utility>
+#include <vector>
+#include "representation.h"
+#include "shapepool.h"
+
+//-----------------------------------------
+//		*** Scene files ***
+//-----------------------------------------
+// CSV scenes as written by ViewerWidget::saveCurrentImageState:
+// ShapeType,ZBufferPosition,IsFilled,BorderColor,FillingColor,Points
+
+struct SceneFile {
+	std::vector<std::pair<Shape*, int>> shapes;	// Shapes (owned by the pool given to loadSceneCsv) and their z-buffer positions, in file order
+	int invalidShapes = 0;						// Lines skipped for an unknown type or a wrong number of points
+	bool formatError = false;					// A line with too few fields stopped the parse
+	int formatErrorLine = 0;					// Line that stopped a CSV parse, counting the header as line 1
+	int firstInvalidLine = 0;					// Line of the first skipped CSV shape
+};
+
+// Creates the shapes in pool; returns false if the file cannot be opened. Large files are parsed in parallel.
+bool loadSceneCsv(const QString& filePath, SceneFile& scene, ShapePool& pool);
+
+// Loads a CSV or binary scene, told apart by content; region as for loadSceneBinary
+bool loadScene(const QString& filePath, SceneFile& scene, ShapePool& pool, const QRect& region = QRect());
+
+QString shapeTypeName(Shape::ShapeType type);
+
+// A new shape in pool as the loaders make it, or nullptr when the number of points does not suit the type
+Shape* createSceneShape(Shape::ShapeType type, PointSpan points, int zBufferPosition, bool isFilled, const QColor& borderColor, const QColor& fillingColor, ShapePool& pool);
+
+//-----------------------------------------
+//		*** Binary scenes ***
+//-----------------------------------------
+// Versioned files laid out for use in place from a memory mapping, every section 8-byte aligned and every
+// value in the little-endian byte order of the platforms the viewer runs on:
+//	header | shape table | coordinates | spatial index
+// The shape table has one fixed-size record per shape, in painter's order. The coordinates are every
+// shape's points back to back as 32-bit x,y pairs, the layout of QPoint, so a mapped file hands out
+// PointSpans without copying. A compressed file keeps them as zlib blocks of whole shapes instead, listed
+// in a block table. The index is a uniform grid over the shape bounds holding, per cell, the table
+// indices of the shapes touching it; shapes spanning too many cells go to one extra list after the cells.
+// Colors are stored as unpremultiplied ARGB, so alpha survives, along with opacity and blend mode.
+
+struct SceneBinaryHeader {
+	enum Flags { CompressedPoints = 1 };
+
+	char magic[8];				// "IVSCENE" and a zero byte
+	quint32 version;
+	quint32 flags;
+	quint64 shapeCount;
+	quint64 pointCount;
+	quint64 shapeTableOffset;
+	quint64 pointsOffset;		// The coordinates, or the block table of a compressed file
+	quint64 blockCount;
+	quint64 indexOffset;
+	qint32 indexLeft;			// Canvas position of the grid's first cell
+	qint32 indexTop;
+	qint32 indexColumns;
+	qint32 indexRows;
+	quint32 indexCellShift;
+	quint32 reserved;
+};
+
+struct SceneBinaryRecord {
+	quint64 firstPoint;
+	quint8 type;				// Shape::ShapeType
+	quint8 isFilled;
+	quint8 blendMode;			// Shape::BlendMode
+	quint8 reserved;
+	qint32 zBufferPosition;
+	quint32 borderColor;		// QRgb
+	quint32 fillingColor;
+	float opacity;
+	quint32 pointCount;
+	qint32 bounds[4];			// Left, top, right and bottom, inclusive
+};
+
+struct SceneBinaryBlock {
+	quint64 firstPoint;
+	quint64 offset;				// qCompress output, from the start of the file
+	quint32 pointCount;
+	quint32 compressedBytes;
+};
+
+// Writes shapes in the order given with their z-buffer positions; returns false if the file cannot be written
+bool saveSceneBinary(const QString& filePath, const std::vector<std::pair<Shape*, int>>& shapes, bool compressPoints = false);
+
+// Creates the shapes reaching into region in pool, or all of them for a null region; returns false if the
+// file cannot be opened. Only the records the index yields for region are visited.
+bool loadSceneBinary(const QString& filePath, SceneFile& scene, ShapePool& pool, const QRect& region = QRect());
+
+// A binary scene mapped into memory. Records, the index and uncompressed coordinates are read in place;
+// compressed blocks are inflated on first use and kept, so points() is not safe to call from several threads.
+class SceneMap {
+public:
+	SceneMap() {}
+	~SceneMap() { close(); }
+	SceneMap(const SceneMap&) = delete;
+	SceneMap& operator=(const SceneMap&) = delete;
+
+	// Returns false if the file cannot be opened or is not a binary scene of a supported version
+	bool open(const QString& filePath);
+	void close();
+	bool isOpen() const { return header != nullptr; }
+	// Set when open() failed on the content rather than on opening the file
+	bool hasFormatError() const { return formatError; }
+
+	int shapeCount() const { return static_cast<int>(header->shapeCount); }
+	const SceneBinaryRecord& record(int index) const { return records[index]; }
+	QRect bounds(int index) const;
+	// Empty for a record whose points lie outside the file
+	PointSpan points(int index);
+
+	// Table indices of the shapes whose bounds intersect rect, in painter's order
+	void query(const QRect& rect, std::vector<int>& result) const;
+
+	// A new shape in pool from the record at index, or nullptr if the record does not make a valid shape
+	Shape* createShape(int index, ShapePool& pool);
+
+	static bool isBinaryScene(const QString& filePath);
+
+private:
+	QFile file;
+	const uchar* base = nullptr;
+	qint64 fileSize = 0;
+	bool formatError = false;
+	const SceneBinaryHeader* header = nullptr;
+	const SceneBinaryRecord* records = nullptr;
+	const QPoint* coordinates = nullptr;
+	const SceneBinaryBlock* blocks = nullptr;
+	std::vector<QByteArray> inflated;
+	const quint64* cellStarts = nullptr;
+	const quint32* cellEntries = nullptr;
+	quint64 entryCount = 0;
+
+	bool validate();
+	int blockOf(quint64 point) const;
+};
@@ -0,0 +1,665 @@
+#include "scenejournal.h"
+#include "instrumentation.h"
+#include "sceneio.h"
+#include <QDir>
+#include <QRunnable>
+#include <QStringList>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <memory>
+
+namespace {
+
+const char journalMagic[8] = { 'I', 'V', 'J', 'O', 'U', 'R', 'N', '\0' };
+const quint32 journalVersion = 1;
+
+struct JournalFileHeader {
+	enum Flags { FromSnapshot = 1 };
+
+	char magic[8];
+	quint32 version;
+	quint32 flags;				// FromSnapshot: replayable only onto the checkpoint of its own generation
+};
+
+// Followed by the shape's points as 32-bit x,y pairs
+struct JournalShape {
+	quint8 type;				// Shape::ShapeType
+	quint8 isFilled;
+	quint8 blendMode;			// Shape::BlendMode
+	quint8 reserved;
+	qint32 depth;
+	quint32 borderColor;		// QRgb, unpremultiplied
+	quint32 fillingColor;
+	float opacity;
+	quint32 pointCount;
+};
+
+// Followed by the positions of the transformed layers as 32-bit integers
+struct JournalTransform {
+	double m11, m12, m21, m22, dx, dy;
+	quint32 count;
+	quint32 reserved;
+};
+
+struct JournalRecolor {
+	qint32 position;
+	quint32 borderColor;
+	quint32 fillingColor;
+	quint32 reserved;
+};
+
+struct JournalReblend {
+	qint32 position;
+	quint32 blendMode;
+	float opacity;
+	quint32 reserved;
+};
+
+struct JournalPosition {
+	qint32 position;
+	quint32 reserved;
+};
+
+int paddedBytes(int bytes)
+{
+	return (bytes + 7) & ~7;
+}
+
+QString checkpointPath(const QString& directory, quint64 generation)
+{
+	return QString("%1/checkpoint-%2.ivs").arg(directory).arg(generation);
+}
+
+QString journalPath(const QString& directory, quint64 generation)
+{
+	return QString("%1/journal-%2.log").arg(directory).arg(generation);
+}
+
+// The generation numbers of the checkpoints and journals in directory, each list ascending
+void listGenerations(const QString& directory, std::vector<quint64>& checkpoints, std::vector<quint64>& journals)
+{
+	auto collect = [&directory](const QString& prefix, const QString& suffix, std::vector<quint64>& generations) {
+		generations.clear();
+		for (const QString& name : QDir(directory).entryList(QStringList() << prefix + "*" + suffix, QDir::Files)) {
+			bool ok = false;
+			quint64 generation = name.mid(prefix.size(), name.size() - prefix.size() - suffix.size()).toULongLong(&ok);
+			if (ok) {
+				generations.push_back(generation);
+			}
+		}
+		std::sort(generations.begin(), generations.end());
+	};
+	collect("checkpoint-", ".ivs", checkpoints);
+	collect("journal-", ".log", journals);
+}
+
+// Unlike the scene loaders this keeps polygons and curves of any length: every layer a record stands for
+// must exist, or the positions in the records after it would point at the wrong layers
+Shape* createJournalShape(const JournalShape& record, PointSpan points, ShapePool& pool)
+{
+	if (record.type > Shape::BEZIER_CURVE) {
+		return nullptr;
+	}
+
+	Shape::ShapeType type = static_cast<Shape::ShapeType>(record.type);
+	QColor borderColor = QColor::fromRgba(record.borderColor);
+	QColor fillingColor = QColor::fromRgba(record.fillingColor);
+	Shape* shape;
+	if (type == Shape::POLYGON) {
+		shape = pool.create<MyPolygon>(points.toVector(), record.depth, record.isFilled != 0, borderColor, fillingColor);
+	}
+	else if (type == Shape::BEZIER_CURVE) {
+		shape = pool.create<BezierCurve>(points.toVector(), record.depth, record.isFilled != 0, borderColor, fillingColor);
+	}
+	else {
+		shape = createSceneShape(type, points, record.depth, record.isFilled != 0, borderColor, fillingColor, pool);
+	}
+	if (shape) {
+		shape->setOpacity(std::isnan(record.opacity) ? 1.0 : record.opacity);
+		shape->setBlendMode(record.blendMode <= Shape::ADDITIVE ? static_cast<Shape::BlendMode>(record.blendMode) : Shape::SOURCE_OVER);
+	}
+	return shape;
+}
+
+// Returns false for a record that does not fit the scene it is replayed onto
+bool applyRecord(const JournalRecordHeader& header, const char* payload, LayerStack& layers, ShapePool& pool)
+{
+	auto isLayer = [&layers](qint32 position) { return position >= 0 && position < layers.size(); };
+
+	switch (header.kind) {
+	case JournalRecordHeader::Add: {
+		JournalShape record;
+		if (header.size < sizeof(record)) {
+			return false;
+		}
+		std::memcpy(&record, payload, sizeof(record));
+		if (record.pointCount > (header.size - sizeof(record)) / sizeof(QPoint)) {
+			return false;
+		}
+		Shape* shape = createJournalShape(record, PointSpan(reinterpret_cast<const QPoint*>(payload + sizeof(record)), static_cast<int>(record.pointCount)), pool);
+		if (!shape) {
+			return false;
+		}
+		layers.insert(shape, record.depth);
+		return true;
+	}
+	case JournalRecordHeader::Transform: {
+		JournalTransform record;
+		if (header.size < sizeof(record)) {
+			return false;
+		}
+		std::memcpy(&record, payload, sizeof(record));
+		if (record.count > (header.size - sizeof(record)) / sizeof(qint32)) {
+			return false;
+		}
+		const QTransform transform(record.m11, record.m12, record.m21, record.m22, record.dx, record.dy);
+		const char* positions = payload + sizeof(record);
+		for (quint32 i = 0; i < record.count; i++) {
+			qint32 position;
+			std::memcpy(&position, positions + i * sizeof(position), sizeof(position));
+			if (!isLayer(position)) {
+				return false;
+			}
+			layers.at(position)->applyTransform(transform);
+		}
+		return true;
+	}
+	case JournalRecordHeader::Recolor: {
+		JournalRecolor record;
+		if (header.size < sizeof(record)) {
+			return false;
+		}
+		std::memcpy(&record, payload, sizeof(record));
+		if (!isLayer(record.position)) {
+			return false;
+		}
+		Shape* shape = layers.at(record.position);
+		shape->setBorderColor(QColor::fromRgba(record.borderColor));
+		shape->setFillingColor(QColor::fromRgba(record.fillingColor));
+		return true;
+	}
+	case JournalRecordHeader::Reblend: {
+		JournalReblend record;
+		if (header.size < sizeof(record)) {
+			return false;
+		}
+		std::memcpy(&record, payload, sizeof(record));
+		if (!isLayer(record.position)) {
+			return false;
+		}
+		Shape* shape = layers.at(record.position);
+		shape->setBlendMode(record.blendMode <= Shape::ADDITIVE ? static_cast<Shape::BlendMode>(record.blendMode) : Shape::SOURCE_OVER);
+		shape->setOpacity(std::isnan(record.opacity) ? 1.0 : record.opacity);
+		return true;
+	}
+	case JournalRecordHeader::Swap:
+	case JournalRecordHeader::Remove: {
+		JournalPosition record;
+		if (header.size < sizeof(record)) {
+			return false;
+		}
+		std::memcpy(&record, payload, sizeof(record));
+		if (header.kind == JournalRecordHeader::Swap) {
+			if (!isLayer(record.position) || !isLayer(record.position + 1)) {
+				return false;
+			}
+			layers.swapAdjacent(record.position);
+			return true;
+		}
+		if (!isLayer(record.position)) {
+			return false;
+		}
+		Shape* shape = layers.at(record.position);
+		layers.removeAt(record.position);
+		pool.release(shape);
+		return true;
+	}
+	case JournalRecordHeader::Clear:
+		layers.clear();
+		pool.clear();
+		return true;
+	}
+	return false;
+}
+
+// Replays the journal at path until its end or the first record cut short or not fitting the scene.
+// Returns false, replaying nothing, for a journal that cannot be read or that starts from a snapshot
+// while its own checkpoint is not the base of the replay.
+bool replayJournal(const QString& path, bool onOwnCheckpoint, LayerStack& layers, ShapePool& pool)
+{
+	QFile file(path);
+	if (!file.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+	const QByteArray bytes = file.readAll();
+	JournalFileHeader fileHeader;
+	if (bytes.size() < static_cast<int>(sizeof(fileHeader))) {
+		return false;
+	}
+	std::memcpy(&fileHeader, bytes.constData(), sizeof(fileHeader));
+	if (std::memcmp(fileHeader.magic, journalMagic, sizeof(journalMagic)) != 0 || fileHeader.version != journalVersion) {
+		return false;
+	}
+	if ((fileHeader.flags & JournalFileHeader::FromSnapshot) && !onOwnCheckpoint) {
+		return false;
+	}
+
+	const char* cursor = bytes.constData() + sizeof(fileHeader);
+	const char* end = bytes.constData() + bytes.size();
+	while (end - cursor >= static_cast<qint64>(sizeof(JournalRecordHeader))) {
+		JournalRecordHeader header;
+		std::memcpy(&header, cursor, sizeof(header));
+		const char* payload = cursor + sizeof(header);
+		if (header.size > static_cast<quint64>(end - payload) || !applyRecord(header, payload, layers, pool)) {
+			break;
+		}
+		cursor = payload + header.size;
+	}
+	return true;
+}
+
+// The scene as it stood when generation end began: the newest checkpoint before end plus the journals
+// from that checkpoint up to end. Returns false if the checkpoint cannot be read. complete is cleared when
+// the replay stops at a journal it cannot use, as one whose snapshot was still being written at a crash;
+// the scene is then as it stood when that journal began.
+bool restoreScene(const QString& directory, quint64 end, LayerStack& layers, ShapePool& pool, bool& complete)
+{
+	std::vector<quint64> checkpoints, journals;
+	listGenerations(directory, checkpoints, journals);
+	complete = true;
+
+	quint64 base = 0;
+	bool hasCheckpoint = false;
+	auto checkpoint = std::lower_bound(checkpoints.begin(), checkpoints.end(), end);
+	if (checkpoint != checkpoints.begin()) {
+		hasCheckpoint = true;
+		base = *--checkpoint;
+		SceneMap map;
+		if (!map.open(checkpointPath(directory, base))) {
+			return false;
+		}
+		std::vector<std::pair<Shape*, int>> shapes;
+		shapes.reserve(map.shapeCount());
+		for (int index = 0; index < map.shapeCount(); index++) {
+			const SceneBinaryRecord& source = map.record(index);
+			JournalShape record;
+			std::memset(&record, 0, sizeof(record));
+			record.type = source.type;
+			record.isFilled = source.isFilled;
+			record.blendMode = source.blendMode;
+			record.depth = source.zBufferPosition;
+			record.borderColor = source.borderColor;
+			record.fillingColor = source.fillingColor;
+			record.opacity = source.opacity;
+			Shape* shape = createJournalShape(record, map.points(index), pool);
+			if (!shape) {
+				return false;
+			}
+			shapes.push_back(std::make_pair(shape, source.zBufferPosition));
+		}
+		layers.insertBulk(shapes);
+	}
+
+	for (quint64 generation : journals) {
+		if (generation < base || generation >= end) {
+			continue;
+		}
+		if (!replayJournal(journalPath(directory, generation), hasCheckpoint && generation == base, layers, pool)) {
+			complete = false;
+			break;
+		}
+	}
+	return true;
+}
+
+void removeGenerationsBefore(const QString& directory, quint64 generation)
+{
+	std::vector<quint64> checkpoints, journals;
+	listGenerations(directory, checkpoints, journals);
+	for (quint64 older : checkpoints) {
+		if (older < generation) {
+			QFile::remove(checkpointPath(directory, older));
+		}
+	}
+	for (quint64 older : journals) {
+		if (older < generation) {
+			QFile::remove(journalPath(directory, older));
+		}
+	}
+}
+
+//-----------------------------------------
+//		*** Checkpoint job ***
+//-----------------------------------------
+
+// Copies of the layers a generation starts from, taken on the GUI thread
+struct SceneSnapshot {
+	ShapePool pool;
+	std::vector<std::pair<Shape*, int>> shapes;
+};
+
+// Writes checkpoint-<generation>, then removes the checkpoints and journals it replaces. Without a snapshot
+// the checkpoint is folded from the files alone, so the GUI thread hands over no copy of the scene.
+class CheckpointJob : public QRunnable {
+public:
+	CheckpointJob(const QString& directory, quint64 generation, std::atomic<int>& queued, SceneSnapshot* snapshot = nullptr)
+		: directory(directory), generation(generation), queued(queued), snapshot(snapshot)
+	{
+	}
+
+	void run() override
+	{
+		INSTRUMENT_SCOPE("SceneJournal::checkpoint");
+		LayerStack layers;
+		ShapePool pool;
+		std::vector<std::pair<Shape*, int>> folded;
+		bool ready = true;
+		if (!snapshot) {
+			// A fold that stops short would drop the edits after the stop
+			bool complete = false;
+			ready = restoreScene(directory, generation, layers, pool, complete) && complete;
+			folded.reserve(layers.size());
+			layers.forEach([&folded](Shape* layer, int depth) { folded.push_back(std::make_pair(layer, depth)); });
+		}
+
+		if (ready) {
+			// Written aside and renamed, so a crash never leaves a partial checkpoint under its final name
+			QString path = checkpointPath(directory, generation);
+			QString partial = path + ".part";
+			if (saveSceneBinary(partial, snapshot ? snapshot->shapes : folded) && (!QFile::exists(path) || QFile::remove(path)) && QFile::rename(partial, path)) {
+				removeGenerationsBefore(directory, generation);
+			}
+		}
+		queued.fetch_sub(1);
+	}
+
+private:
+	QString directory;
+	quint64 generation;
+	std::atomic<int>& queued;
+	std::unique_ptr<SceneSnapshot> snapshot;
+};
+
+}
+
+//-----------------------------------------
+//		*** Scene journal ***
+//-----------------------------------------
+
+SceneJournal::SceneJournal()
+	: queuedCheckpoints(0)
+{
+	worker.setMaxThreadCount(1);
+}
+
+SceneJournal::~SceneJournal()
+{
+	close();
+}
+
+bool SceneJournal::recover(const QString& directory, LayerStack& layers, ShapePool& pool)
+{
+	INSTRUMENT_SCOPE("SceneJournal::recover");
+	std::vector<quint64> checkpoints, journals;
+	listGenerations(directory, checkpoints, journals);
+	if (checkpoints.empty() && journals.empty()) {
+		return false;
+	}
+
+	bool complete = false;
+	if (restoreScene(directory, std::numeric_limits<quint64>::max(), layers, pool, complete)) {
+		return true;
+	}
+
+	// Nothing can be built on an unreadable checkpoint; its generations are kept aside, out of the way
+	// of the ones the next session writes
+	layers.clear();
+	pool.clear();
+	for (quint64 generation : checkpoints) {
+		QFile::rename(checkpointPath(directory, generation), checkpointPath(directory, generation) + ".damaged");
+	}
+	for (quint64 generation : journals) {
+		QFile::rename(journalPath(directory, generation), journalPath(directory, generation) + ".damaged");
+	}
+	return false;
+}
+
+bool SceneJournal::open(const QString& directory, const std::vector<std::pair<Shape*, int>>& scene)
+{
+	close();
+	failed = true;
+	if (!QDir().mkpath(directory)) {
+		return false;
+	}
+	this->directory = directory;
+
+	std::vector<quint64> checkpoints, journals;
+	listGenerations(directory, checkpoints, journals);
+	quint64 next = 0;
+	if (!checkpoints.empty()) {
+		next = checkpoints.back() + 1;
+	}
+	if (!journals.empty()) {
+		next = std::max(next, journals.back() + 1);
+	}
+	if (!beginGeneration(next, true)) {
+		return false;
+	}
+	failed = false;
+	startSnapshot(scene);
+	return true;
+}
+
+void SceneJournal::recordScene(const std::vector<std::pair<Shape*, int>>& scene)
+{
+	// Records made before the scene was replaced go to the old generation, which recovery falls back to
+	// if a crash comes before the snapshot is written. A clear that began the replacement stays out of
+	// it: replayed there, it would leave that fallback an empty scene.
+	if (pendingClear >= 0) {
+		pending.truncate(pendingClear);
+		pendingClear = -1;
+	}
+	flush();
+	if (!isOpen() || !beginGeneration(generation + 1, true)) {
+		return;
+	}
+	startSnapshot(scene);
+}
+
+void SceneJournal::startSnapshot(const std::vector<std::pair<Shape*, int>>& scene)
+{
+	INSTRUMENT_SCOPE("SceneJournal::snapshot");
+	SceneSnapshot* snapshot = new SceneSnapshot;
+	snapshot->shapes.reserve(scene.size());
+	for (const auto& entry : scene) {
+		snapshot->shapes.push_back(std::make_pair(snapshot->pool.clone(*entry.first), entry.second));
+	}
+	queuedCheckpoints.fetch_add(1);
+	worker.start(new CheckpointJob(directory, generation, queuedCheckpoints, snapshot));
+}
+
+void SceneJournal::close()
+{
+	flush();
+	file.close();
+	worker.waitForDone();
+}
+
+bool SceneJournal::beginGeneration(quint64 next, bool fromSnapshot)
+{
+	file.close();
+	file.setFileName(journalPath(directory, next));
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		failed = true;
+		return false;
+	}
+
+	JournalFileHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, journalMagic, sizeof(journalMagic));
+	header.version = journalVersion;
+	header.flags = fromSnapshot ? JournalFileHeader::FromSnapshot : 0;
+	if (file.write(reinterpret_cast<const char*>(&header), sizeof(header)) != sizeof(header)) {
+		file.close();
+		failed = true;
+		return false;
+	}
+	generation = next;
+	journalBytes = sizeof(header);
+	return true;
+}
+
+char* SceneJournal::append(JournalRecordHeader::Kind kind, int payloadBytes)
+{
+	if (!isOpen()) {
+		return nullptr;
+	}
+
+	mergeableTransform = -1;
+	pendingClear = -1;
+	JournalRecordHeader header = { static_cast<quint32>(kind), static_cast<quint32>(paddedBytes(payloadBytes)) };
+	int offset = pending.size();
+	pending.resize(offset + static_cast<int>(sizeof(header) + header.size));
+	char* record = pending.data() + offset;
+	std::memset(record, 0, sizeof(header) + header.size);
+	std::memcpy(record, &header, sizeof(header));
+	return record + sizeof(header);
+}
+
+void SceneJournal::recordAdd(const Shape& shape, int depth)
+{
+	PointSpan points = shape.pointSpan();
+	char* payload = append(JournalRecordHeader::Add, static_cast<int>(sizeof(JournalShape) + points.size() * sizeof(QPoint)));
+	if (!payload) {
+		return;
+	}
+
+	JournalShape record;
+	std::memset(&record, 0, sizeof(record));
+	record.type = static_cast<quint8>(shape.getType());
+	record.isFilled = shape.getIsFilled() ? 1 : 0;
+	record.blendMode = static_cast<quint8>(shape.getBlendMode());
+	record.depth = depth;
+	record.borderColor = shape.getBorderColor().rgba();
+	record.fillingColor = shape.getFillingColor().rgba();
+	record.opacity = static_cast<float>(shape.getOpacity());
+	record.pointCount = static_cast<quint32>(points.size());
+	std::memcpy(payload, &record, sizeof(record));
+	if (!points.isEmpty()) {
+		std::memcpy(payload + sizeof(record), points.begin(), points.size() * sizeof(QPoint));
+	}
+}
+
+void SceneJournal::recordTransform(const std::vector<int>& positions, const QTransform& transform)
+{
+	if (!isOpen() || positions.empty()) {
+		return;
+	}
+
+	const size_t positionBytes = positions.size() * sizeof(qint32);
+	JournalTransform record;
+	if (mergeableTransform >= 0) {
+		char* previous = pending.data() + mergeableTransform + sizeof(JournalRecordHeader);
+		std::memcpy(&record, previous, sizeof(record));
+		if (record.count == positions.size() && std::memcmp(previous + sizeof(record), positions.data(), positionBytes) == 0) {
+			// Applied after the merged ones, as Shape::applyTransform composes
+			QTransform merged = QTransform(record.m11, record.m12, record.m21, record.m22, record.dx, record.dy) * transform;
+			record.m11 = merged.m11();
+			record.m12 = merged.m12();
+			record.m21 = merged.m21();
+			record.m22 = merged.m22();
+			record.dx = merged.dx();
+			record.dy = merged.dy();
+			std::memcpy(previous, &record, sizeof(record));
+			return;
+		}
+	}
+
+	int offset = pending.size();
+	char* payload = append(JournalRecordHeader::Transform, static_cast<int>(sizeof(record) + positionBytes));
+	std::memset(&record, 0, sizeof(record));
+	record.m11 = transform.m11();
+	record.m12 = transform.m12();
+	record.m21 = transform.m21();
+	record.m22 = transform.m22();
+	record.dx = transform.dx();
+	record.dy = transform.dy();
+	record.count = static_cast<quint32>(positions.size());
+	std::memcpy(payload, &record, sizeof(record));
+	std::memcpy(payload + sizeof(record), positions.data(), positionBytes);
+	mergeableTransform = offset;
+}
+
+void SceneJournal::recordRecolor(int position, const QColor& borderColor, const QColor& fillingColor)
+{
+	char* payload = append(JournalRecordHeader::Recolor, sizeof(JournalRecolor));
+	if (payload) {
+		JournalRecolor record = { position, borderColor.rgba(), fillingColor.rgba(), 0 };
+		std::memcpy(payload, &record, sizeof(record));
+	}
+}
+
+void SceneJournal::recordReblend(int position, Shape::BlendMode blendMode, double opacity)
+{
+	char* payload = append(JournalRecordHeader::Reblend, sizeof(JournalReblend));
+	if (payload) {
+		JournalReblend record = { position, static_cast<quint32>(blendMode), static_cast<float>(opacity), 0 };
+		std::memcpy(payload, &record, sizeof(record));
+	}
+}
+
+void SceneJournal::recordSwap(int position)
+{
+	char* payload = append(JournalRecordHeader::Swap, sizeof(JournalPosition));
+	if (payload) {
+		JournalPosition record = { position, 0 };
+		std::memcpy(payload, &record, sizeof(record));
+	}
+}
+
+void SceneJournal::recordRemove(int position)
+{
+	char* payload = append(JournalRecordHeader::Remove, sizeof(JournalPosition));
+	if (payload) {
+		JournalPosition record = { position, 0 };
+		std::memcpy(payload, &record, sizeof(record));
+	}
+}
+
+void SceneJournal::recordClear()
+{
+	int offset = pending.size();
+	if (append(JournalRecordHeader::Clear, 0)) {
+		pendingClear = offset;
+	}
+}
+
+void SceneJournal::flush()
+{
+	if (!isOpen() || pending.isEmpty()) {
+		return;
+	}
+
+	INSTRUMENT_SCOPE("SceneJournal::flush");
+	bool written = file.write(pending.constData(), pending.size()) == pending.size() && file.flush();
+	journalBytes += pending.size();
+	pending.clear();
+	mergeableTransform = -1;
+	pendingClear = -1;
+	if (!written) {
+		// Records after a lost one would replay onto the wrong scene, so the journal ends here
+		file.close();
+		failed = true;
+		return;
+	}
+
+	if (journalBytes >= checkpointBytes && queuedCheckpoints.load() == 0) {
+		if (!beginGeneration(generation + 1, false)) {
+			return;
+		}
+		queuedCheckpoints.fetch_add(1);
+		worker.start(new CheckpointJob(directory, generation, queuedCheckpoints));
+	}
+}
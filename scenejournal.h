@@ -0,0 +1,101 @@
+#pragma once
+#include <QByteArray>
+#include <QColor>
+#include <QFile>
+#include <QString>
+#include <QThreadPool>
+#include <QTransform>
+#include <atomic>
+#include <utility>
+#include <vector>
+#include "layerstack.h"
+#include "representation.h"
+#include "shapepool.h"
+
+//-----------------------------------------
+//		*** Scene journal ***
+//-----------------------------------------
+// Autosave as an append-only log: every edit is appended as one compact binary record, so saving costs
+// in proportion to the edit rather than to the scene. The directory holds numbered generations:
+//	checkpoint-N.ivs	the scene as it stood when generation N began, as a binary scene
+//	journal-N.log		the edits made during generation N
+// Without a checkpoint the scene started out empty. Once a journal outgrows checkpointBytes the next
+// generation begins and a worker thread folds the finished journals into the newest checkpoint. Opening
+// the journal and replacing the whole scene, as loading a file does, instead begin a generation from a
+// copy of the scene, which the worker writes as its checkpoint; that generation's journal is replayed
+// only onto its own checkpoint, so a crash before the copy is written recovers the scene from before.
+// A new checkpoint is complete before anything it replaces is removed, so the directory always holds one
+// checkpoint and every journal after it, and recovery is that checkpoint plus the journals replayed.
+//
+// Records address layers by their position at the time of the edit, which replay reproduces exactly.
+// Checkpoints keep pixel positions, so a transform replayed onto a shape from a checkpoint may round
+// one pixel differently from the session that made it.
+
+struct JournalRecordHeader {
+	enum Kind { Add = 1, Transform, Recolor, Reblend, Swap, Remove, Clear };
+
+	quint32 kind;
+	quint32 size;				// Payload bytes that follow, padded to a multiple of 8
+};
+
+class SceneJournal {
+public:
+	SceneJournal();
+	~SceneJournal();
+	SceneJournal(const SceneJournal&) = delete;
+	SceneJournal& operator=(const SceneJournal&) = delete;
+
+	// Past this many journal bytes the next flush begins a generation and starts a checkpoint
+	static const qint64 checkpointBytes = 8 << 20;
+
+	// Rebuilds the scene kept in directory into layers, with the shapes created in pool; returns false
+	// when there is nothing to recover or the checkpoint cannot be read, in which case the files found
+	// are renamed aside and layers is left empty. Replay stops at a record cut short, as a crash during
+	// a write leaves one.
+	static bool recover(const QString& directory, LayerStack& layers, ShapePool& pool);
+
+	// Begins a generation after those in directory from scene, the layers in painter's order with their
+	// depths, whatever was or was not recovered
+	bool open(const QString& directory, const std::vector<std::pair<Shape*, int>>& scene);
+	// Flushes, then waits for a checkpoint in progress
+	void close();
+	bool isOpen() const { return file.isOpen(); }
+	// The journal could not be opened or a write failed, so it closed and edits are no longer saved
+	bool hasFailed() const { return failed; }
+
+	// Each records one edit; nothing is recorded while the journal is closed
+	void recordAdd(const Shape& shape, int depth);
+	// Consecutive transforms of the same layers merge until the next flush, so a drag costs one record
+	void recordTransform(const std::vector<int>& positions, const QTransform& transform);
+	void recordRecolor(int position, const QColor& borderColor, const QColor& fillingColor);
+	void recordReblend(int position, Shape::BlendMode blendMode, double opacity);
+	// The layers at position and position + 1 were exchanged
+	void recordSwap(int position);
+	void recordRemove(int position);
+	void recordClear();
+	// The scene was replaced as a whole: begins a generation from a copy of it instead of a record per shape.
+	// A clear recorded just before is dropped, since the copy stands for it.
+	void recordScene(const std::vector<std::pair<Shape*, int>>& scene);
+
+	// Writes the records gathered since the last flush
+	void flush();
+	bool hasPendingRecords() const { return !pending.isEmpty(); }
+
+private:
+	QString directory;
+	QFile file;
+	quint64 generation = 0;
+	qint64 journalBytes = 0;
+	QByteArray pending;
+	// Offset in pending of a transform record later ones may merge into, or -1
+	int mergeableTransform = -1;
+	// Offset in pending of a clear no record has followed yet, or -1
+	int pendingClear = -1;
+	bool failed = false;
+	QThreadPool worker;
+	std::atomic<int> queuedCheckpoints;
+
+	char* append(JournalRecordHeader::Kind kind, int payloadBytes);
+	bool beginGeneration(quint64 next, bool fromSnapshot);
+	void startSnapshot(const std::vector<std::pair<Shape*, int>>& scene);
+};
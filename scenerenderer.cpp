@@ -0,0 +1,121 @@
+#include "scenerenderer.h"
+#include "instrumentation.h"
+#include <QMetaObject>
+#include <QRunnable>
+#include <algorithm>
+
+QRegion RenderSnapshot::region() const
+{
+	QRegion area;
+	for (const QRect& rect : rects) {
+		area += rect;
+	}
+	return area;
+}
+
+//-----------------------------------------
+//		*** Frame job ***
+//-----------------------------------------
+
+namespace {
+
+class FrameJob : public QRunnable {
+public:
+	FrameJob(const std::shared_ptr<RenderSnapshot>& snapshot, TileRenderer& renderer, QImage& back, QObject* receiver, const std::function<void()>& done)
+		: snapshot(snapshot), renderer(renderer), back(back), receiver(receiver), done(done)
+	{
+	}
+
+	void run() override
+	{
+		INSTRUMENT_SCOPE("SceneRenderer::frame");
+		// Only this job touches the back buffer while the frame is in flight
+		if (back.size() != snapshot->canvasSize) {
+			back = QImage(snapshot->canvasSize, QImage::Format_ARGB32_Premultiplied);
+		}
+
+		renderer.setCancelFlag(&snapshot->cancelled);
+		for (const QRect& rect : snapshot->rects) {
+			if (snapshot->cancelled.load(std::memory_order_relaxed)) {
+				break;
+			}
+			renderer.render(back, snapshot->shapes, rect, snapshot->background);
+		}
+		renderer.setCancelFlag(nullptr);
+
+		QMetaObject::invokeMethod(receiver, done, Qt::QueuedConnection);
+	}
+
+private:
+	std::shared_ptr<RenderSnapshot> snapshot;
+	TileRenderer& renderer;
+	QImage& back;
+	QObject* receiver;
+	std::function<void()> done;
+};
+
+}
+
+//-----------------------------------------
+//		*** Scene renderer ***
+//-----------------------------------------
+
+SceneRenderer::SceneRenderer()
+{
+	// Frames run one after another; the tiles of each still spread over every core
+	worker.setMaxThreadCount(1);
+}
+
+SceneRenderer::~SceneRenderer()
+{
+	cancel();
+	wait();
+}
+
+void SceneRenderer::start(const std::shared_ptr<RenderSnapshot>& snapshot, QObject* receiver, const std::function<void()>& done)
+{
+	Q_ASSERT(!current);
+	current = snapshot;
+	// A frame ended early by finish() leaves its callback with nothing to do
+	std::function<void()> guarded = [this, snapshot, done]() {
+		if (current == snapshot) {
+			done();
+		}
+	};
+	worker.start(new FrameJob(snapshot, tileRenderer, back, receiver, guarded));
+}
+
+void SceneRenderer::cancel()
+{
+	if (current) {
+		current->cancelled.store(true, std::memory_order_relaxed);
+	}
+}
+
+void SceneRenderer::wait()
+{
+	worker.waitForDone();
+}
+
+QRegion SceneRenderer::finish(QImage& target)
+{
+	if (!current) {
+		return QRegion();
+	}
+
+	INSTRUMENT_SCOPE("SceneRenderer::finish");
+	std::shared_ptr<RenderSnapshot> frame;
+	frame.swap(current);
+	if (frame->cancelled.load(std::memory_order_relaxed) || target.size() != frame->canvasSize) {
+		return QRegion();
+	}
+
+	for (const QRect& rect : frame->rects) {
+		for (int y = rect.top(); y <= rect.bottom(); y++) {
+			const QRgb* source = reinterpret_cast<const QRgb*>(back.constScanLine(y));
+			QRgb* row = reinterpret_cast<QRgb*>(target.scanLine(y));
+			std::copy(source + rect.left(), source + rect.right() + 1, row + rect.left());
+		}
+	}
+	return frame->region();
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <QImage>
+#include <QObject>
+#include <QRect>
+#include <QRegion>
+#include <QThreadPool>
+#include <QVector>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "shapepool.h"
+#include "tilerenderer.h"
+
+// Everything one redraw reads, copied out of the scene so the GUI thread can go on editing it.
+// Nothing in a snapshot changes once it is handed to SceneRenderer, except the cancelled flag.
+struct RenderSnapshot {
+	QSize canvasSize;
+	QVector<QRect> rects;
+	QRgb background = qRgb(255, 255, 255);
+	// Owns the copies in shapes, which are in painter's order
+	ShapePool pool;
+	std::vector<Shape*> shapes;
+	std::atomic<bool> cancelled{ false };
+
+	QRegion region() const;
+};
+
+// Renders snapshots on a worker thread into a back buffer of its own, one frame at a time.
+// The owner is called back on its own thread when a frame is done or cancelled, and then publishes it
+// with finish(), which copies the frame's rects into the displayed image in one step: a half drawn
+// frame is never shown, and a cancelled one never at all.
+class SceneRenderer {
+public:
+	SceneRenderer();
+	~SceneRenderer();
+	SceneRenderer(const SceneRenderer&) = delete;
+	SceneRenderer& operator=(const SceneRenderer&) = delete;
+
+	// Starts rendering snapshot, which must not happen while busy. done is queued to receiver's thread
+	// afterwards, unless finish() has ended the frame by then.
+	void start(const std::shared_ptr<RenderSnapshot>& snapshot, QObject* receiver, const std::function<void()>& done);
+	bool isBusy() const { return current != nullptr; }
+	QRegion busyRegion() const { return current ? current->region() : QRegion(); }
+
+	// Asks the frame in flight to stop at its next check; it still has to be ended with finish()
+	void cancel();
+	// Blocks until the frame in flight has stopped rendering
+	void wait();
+	// Ends a frame that has stopped rendering. Unless it was cancelled or target no longer has its size,
+	// its rects are copied into target and returned as the area to repaint.
+	QRegion finish(QImage& target);
+
+private:
+	QThreadPool worker;
+	TileRenderer tileRenderer;
+	QImage back;
+	std::shared_ptr<RenderSnapshot> current;
+};
@@ -0,0 +1,110 @@
+#include "shapepool.h"
+
+ShapePool::ShapePool()
+{
+}
+
+ShapePool::~ShapePool()
+{
+	for (int index = 0; index < static_cast<int>(entries.size()); index++) {
+		if (entries[index].shape) {
+			destroy(index);
+		}
+	}
+	for (char* chunk : chunks) {
+		::operator delete(chunk, std::align_val_t(prefixSize));
+	}
+}
+
+int ShapePool::acquire()
+{
+	int index;
+	if (!freeSlots.empty()) {
+		index = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	else {
+		if (cursor == static_cast<int>(entries.size())) {
+			chunks.push_back(static_cast<char*>(::operator new(static_cast<size_t>(chunkSlots) * slotBytes, std::align_val_t(prefixSize))));
+			entries.resize(entries.size() + chunkSlots, { nullptr, 0, 0 });
+		}
+		index = cursor++;
+		// A shape left over from before the last clear()
+		if (entries[index].shape) {
+			destroy(index);
+		}
+	}
+
+	*reinterpret_cast<int*>(slotAt(index)) = index;
+	entries[index].generation++;
+	entries[index].epoch = epoch;
+	return index;
+}
+
+void ShapePool::destroy(int index)
+{
+	entries[index].shape->~Shape();
+	entries[index].shape = nullptr;
+}
+
+Shape* ShapePool::clone(const Shape& shape)
+{
+	switch (shape.getType()) {
+	case Shape::LINE:
+		return create<Line>(static_cast<const Line&>(shape));
+	case Shape::RECTANGLE:
+		return create<MyRectangle>(static_cast<const MyRectangle&>(shape));
+	case Shape::POLYGON:
+		return create<MyPolygon>(static_cast<const MyPolygon&>(shape));
+	case Shape::CIRCLE:
+		return create<Circle>(static_cast<const Circle&>(shape));
+	case Shape::BEZIER_CURVE:
+		return create<BezierCurve>(static_cast<const BezierCurve&>(shape));
+	}
+	return nullptr;
+}
+
+ShapeHandle ShapePool::handleOf(const Shape* shape) const
+{
+	if (!shape) {
+		return ShapeHandle();
+	}
+
+	int index = *reinterpret_cast<const int*>(reinterpret_cast<const char*>(shape) - prefixSize);
+	if (index < 0 || index >= static_cast<int>(entries.size()) || entries[index].shape != shape || !isLive(index)) {
+		return ShapeHandle();
+	}
+	return { index, entries[index].generation };
+}
+
+Shape* ShapePool::get(const ShapeHandle& handle) const
+{
+	if (handle.index < 0 || handle.index >= static_cast<int>(entries.size())) {
+		return nullptr;
+	}
+	const Entry& slot = entries[handle.index];
+	return isLive(handle.index) && slot.generation == handle.generation ? slot.shape : nullptr;
+}
+
+void ShapePool::release(const ShapeHandle& handle)
+{
+	if (!get(handle)) {
+		return;
+	}
+	destroy(handle.index);
+	freeSlots.push_back(handle.index);
+	liveCount--;
+}
+
+void ShapePool::release(Shape* shape)
+{
+	release(handleOf(shape));
+}
+
+void ShapePool::clear()
+{
+	epoch++;
+	cursor = 0;
+	freeSlots.clear();
+	liveCount = 0;
+}
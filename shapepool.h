@@ -0,0 +1,87 @@
+#pragma once
+#include <QtGlobal>
+#include <algorithm>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "representation.h"
+
+// Refers to a pooled shape without keeping it alive: resolves to nullptr once the shape is released
+// or its pool cleared, even after the slot has been reused by another shape.
+struct ShapeHandle {
+	int index = -1;
+	quint32 generation = 0;
+
+	bool isNull() const { return index < 0; }
+	bool operator==(const ShapeHandle& other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(const ShapeHandle& other) const { return !(*this == other); }
+};
+
+// Owns the shapes of a scene. Every shape type shares one slot size, so a released slot can take any
+// shape; slots come in fixed chunks, so a shape never moves while it lives. Released slots are reused
+// before the pool grows, which keeps a long session at the footprint of its largest scene.
+//
+// clear() is O(1): it starts a new epoch, after which no old handle resolves and every slot is free.
+// The old shapes are destroyed lazily, when their slot is handed out again or the pool goes away.
+class ShapePool {
+public:
+	ShapePool();
+	~ShapePool();
+	ShapePool(const ShapePool&) = delete;
+	ShapePool& operator=(const ShapePool&) = delete;
+
+	template<typename T, typename... Args>
+	T* create(Args&&... args)
+	{
+		static_assert(std::is_base_of<Shape, T>::value, "ShapePool only holds shapes");
+		static_assert(sizeof(T) <= objectSize && alignof(T) <= prefixSize, "Shape type too large for the pool slots");
+		int index = acquire();
+		T* shape = new (objectAt(index)) T(std::forward<Args>(args)...);
+		entries[index].shape = shape;
+		liveCount++;
+		return shape;
+	}
+
+	// A copy of shape, which may belong to another pool
+	Shape* clone(const Shape& shape);
+
+	// Shapes passed in must come from this pool
+	ShapeHandle handleOf(const Shape* shape) const;
+	void release(Shape* shape);
+
+	Shape* get(const ShapeHandle& handle) const;
+	void release(const ShapeHandle& handle);
+	void clear();
+
+	int size() const { return liveCount; }
+	qint64 reservedBytes() const { return static_cast<qint64>(chunks.size()) * chunkSlots * slotBytes; }
+
+private:
+	static const int chunkShift = 10;
+	static const int chunkSlots = 1 << chunkShift;
+	// Each object is preceded by its slot index, which handleOf reads back
+	static const size_t prefixSize = 16;
+	static const size_t objectSize = std::max({ sizeof(Line), sizeof(MyRectangle), sizeof(MyPolygon), sizeof(Circle), sizeof(BezierCurve) });
+	static const size_t slotBytes = (prefixSize + objectSize + prefixSize - 1) / prefixSize * prefixSize;
+
+	struct Entry {
+		Shape* shape;		// Non-null while the slot holds a constructed shape, possibly from an earlier epoch
+		quint32 generation;
+		quint32 epoch;
+	};
+
+	std::vector<char*> chunks;
+	std::vector<Entry> entries;
+	std::vector<int> freeSlots;
+	// Slots at or above the cursor have not been handed out in the current epoch
+	int cursor = 0;
+	quint32 epoch = 1;
+	int liveCount = 0;
+
+	char* slotAt(int index) const { return chunks[index >> chunkShift] + static_cast<size_t>(index & (chunkSlots - 1)) * slotBytes; }
+	void* objectAt(int index) const { return slotAt(index) + prefixSize; }
+	bool isLive(int index) const { return entries[index].shape && entries[index].epoch == epoch; }
+	int acquire();
+	void destroy(int index);
+};
@@ -0,0 +1,338 @@
+#include "spatialindex.h"
+#include "instrumentation.h"
+#include <QPointF>
+#include <QVector>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+double segmentDistanceSquared(const QPointF& point, const QPointF& start, const QPointF& end)
+{
+	QPointF direction = end - start;
+	double lengthSquared = direction.x() * direction.x() + direction.y() * direction.y();
+	double t = 0.0;
+	if (lengthSquared > 0.0) {
+		QPointF offset = point - start;
+		t = std::clamp((offset.x() * direction.x() + offset.y() * direction.y()) / lengthSquared, 0.0, 1.0);
+	}
+	QPointF nearest = start + direction * t;
+	double dx = point.x() - nearest.x(), dy = point.y() - nearest.y();
+	return dx * dx + dy * dy;
+}
+
+bool nearPolyline(const QVector<QPointF>& points, bool closed, const QPointF& point, double toleranceSquared)
+{
+	if (points.size() == 1) {
+		return segmentDistanceSquared(point, points[0], points[0]) <= toleranceSquared;
+	}
+	for (int i = 0; i + 1 < points.size(); i++) {
+		if (segmentDistanceSquared(point, points[i], points[i + 1]) <= toleranceSquared) {
+			return true;
+		}
+	}
+	return closed && points.size() > 2 && segmentDistanceSquared(point, points.last(), points.first()) <= toleranceSquared;
+}
+
+// Even-odd rule, as used by the rasterizer's span fill
+bool insidePolygon(const QVector<QPointF>& points, const QPointF& point)
+{
+	bool inside = false;
+	for (int i = 0, j = points.size() - 1; i < points.size(); j = i++) {
+		const QPointF& a = points[i];
+		const QPointF& b = points[j];
+		if ((a.y() > point.y()) != (b.y() > point.y())
+			&& point.x() < a.x() + (point.y() - a.y()) * (b.x() - a.x()) / (b.y() - a.y())) {
+			inside = !inside;
+		}
+	}
+	return inside;
+}
+
+QVector<QPointF> toPointsF(PointSpan points)
+{
+	QVector<QPointF> result;
+	result.reserve(points.size());
+	for (const QPoint& point : points) {
+		result.append(QPointF(point));
+	}
+	return result;
+}
+
+// Curves are picked against a fixed subdivision, which is well within picking tolerance
+QVector<QPointF> sampleBezier(PointSpan controlPoints)
+{
+	const int samples = 64;
+	QVector<QPointF> result;
+	QVector<QPointF> work(controlPoints.size());
+	result.reserve(samples + 1);
+	for (int s = 0; s <= samples; s++) {
+		double t = static_cast<double>(s) / samples;
+		for (int i = 0; i < controlPoints.size(); i++) {
+			work[i] = QPointF(controlPoints[i]);
+		}
+		for (int level = controlPoints.size() - 1; level > 0; level--) {
+			for (int i = 0; i < level; i++) {
+				work[i] = work[i] * (1.0 - t) + work[i + 1] * t;
+			}
+		}
+		result.append(work[0]);
+	}
+	return result;
+}
+
+}
+
+//-----------------------------------------
+//		*** Maintenance ***
+//-----------------------------------------
+
+SpatialIndex::SpatialIndex(int cellShift)
+	: cellShift(cellShift)
+{
+}
+
+QRect SpatialIndex::cellRange(const QRect& bounds) const
+{
+	// Arithmetic shifts floor negative coordinates into the right cell
+	return QRect(QPoint(bounds.left() >> cellShift, bounds.top() >> cellShift), QPoint(bounds.right() >> cellShift, bounds.bottom() >> cellShift));
+}
+
+void SpatialIndex::link(int index)
+{
+	Entry& entry = entries[index];
+	QRect range = cellRange(entry.bounds);
+	entry.oversized = static_cast<qint64>(range.width()) * range.height() > maxCellsPerShape;
+	if (entry.oversized) {
+		oversized.push_back(index);
+		return;
+	}
+
+	for (int row = range.top(); row <= range.bottom(); row++) {
+		for (int column = range.left(); column <= range.right(); column++) {
+			cells[cellKey(column, row)].push_back(index);
+		}
+	}
+}
+
+void SpatialIndex::unlink(int index)
+{
+	auto drop = [index](std::vector<int>& list) {
+		auto it = std::find(list.begin(), list.end(), index);
+		if (it != list.end()) {
+			*it = list.back();
+			list.pop_back();
+		}
+	};
+
+	const Entry& entry = entries[index];
+	if (entry.oversized) {
+		drop(oversized);
+		return;
+	}
+
+	QRect range = cellRange(entry.bounds);
+	for (int row = range.top(); row <= range.bottom(); row++) {
+		for (int column = range.left(); column <= range.right(); column++) {
+			auto cell = cells.find(cellKey(column, row));
+			if (cell == cells.end()) {
+				continue;
+			}
+			drop(cell->second);
+			if (cell->second.empty()) {
+				cells.erase(cell);
+			}
+		}
+	}
+}
+
+void SpatialIndex::renumber(int from, int to)
+{
+	auto rename = [from, to](std::vector<int>& list) {
+		std::replace(list.begin(), list.end(), from, to);
+	};
+
+	const Entry& entry = entries[from];
+	if (entry.oversized) {
+		rename(oversized);
+		return;
+	}
+
+	QRect range = cellRange(entry.bounds);
+	for (int row = range.top(); row <= range.bottom(); row++) {
+		for (int column = range.left(); column <= range.right(); column++) {
+			rename(cells[cellKey(column, row)]);
+		}
+	}
+}
+
+void SpatialIndex::insert(Shape* shape)
+{
+	if (indices.count(shape)) {
+		update(shape);
+		return;
+	}
+
+	int index = static_cast<int>(entries.size());
+	entries.push_back({ shape, shape->getBoundingRect().adjusted(-1, -1, 1, 1), false, 0 });
+	indices[shape] = index;
+	link(index);
+}
+
+void SpatialIndex::update(Shape* shape)
+{
+	auto found = indices.find(shape);
+	if (found == indices.end()) {
+		return;
+	}
+
+	int index = found->second;
+	QRect bounds = shape->getBoundingRect().adjusted(-1, -1, 1, 1);
+	if (bounds == entries[index].bounds) {
+		return;
+	}
+	if (!entries[index].oversized && cellRange(bounds) == cellRange(entries[index].bounds)) {
+		entries[index].bounds = bounds;
+		return;
+	}
+
+	unlink(index);
+	entries[index].bounds = bounds;
+	link(index);
+}
+
+void SpatialIndex::remove(const Shape* shape)
+{
+	auto found = indices.find(shape);
+	if (found == indices.end()) {
+		return;
+	}
+
+	// The last entry moves into the freed index, so the indices stay dense
+	int index = found->second;
+	int last = static_cast<int>(entries.size()) - 1;
+	unlink(index);
+	indices.erase(found);
+	if (index != last) {
+		renumber(last, index);
+		entries[index] = entries[last];
+		indices[entries[index].shape] = index;
+	}
+	entries.pop_back();
+}
+
+void SpatialIndex::clear()
+{
+	entries.clear();
+	indices.clear();
+	cells.clear();
+	oversized.clear();
+}
+
+//-----------------------------------------
+//		*** Queries ***
+//-----------------------------------------
+
+void SpatialIndex::collect(const QRect& rect)
+{
+	hits.clear();
+	if (entries.empty() || rect.isEmpty()) {
+		return;
+	}
+
+	if (++stamp == 0) {
+		for (Entry& entry : entries) {
+			entry.stamp = 0;
+		}
+		stamp = 1;
+	}
+
+	auto visit = [this, &rect](int index) {
+		Entry& entry = entries[index];
+		if (entry.stamp != stamp && entry.bounds.intersects(rect)) {
+			entry.stamp = stamp;
+			hits.push_back(index);
+		}
+	};
+
+	// Past the point where walking the cells costs more than testing every shape, scan the shapes
+	QRect range = cellRange(rect);
+	if (static_cast<qint64>(range.width()) * range.height() > static_cast<qint64>(entries.size())) {
+		for (int index = 0; index < static_cast<int>(entries.size()); index++) {
+			visit(index);
+		}
+	}
+	else {
+		for (int row = range.top(); row <= range.bottom(); row++) {
+			for (int column = range.left(); column <= range.right(); column++) {
+				auto cell = cells.find(cellKey(column, row));
+				if (cell != cells.end()) {
+					for (int index : cell->second) {
+						visit(index);
+					}
+				}
+			}
+		}
+		for (int index : oversized) {
+			visit(index);
+		}
+	}
+}
+
+void SpatialIndex::query(const QRect& rect, std::vector<Shape*>& result)
+{
+	INSTRUMENT_SCOPE("SpatialIndex::query");
+	collect(rect);
+	result.clear();
+	result.reserve(hits.size());
+	for (int index : hits) {
+		result.push_back(entries[index].shape);
+	}
+}
+
+void SpatialIndex::hitsAt(const QPoint& point, int tolerance, std::vector<Shape*>& result)
+{
+	INSTRUMENT_SCOPE("SpatialIndex::hitsAt");
+	collect(QRect(point.x() - tolerance, point.y() - tolerance, 2 * tolerance + 1, 2 * tolerance + 1));
+	result.clear();
+	for (int index : hits) {
+		Shape* shape = entries[index].shape;
+		if (hitTest(*shape, point, tolerance)) {
+			result.push_back(shape);
+		}
+	}
+}
+
+bool SpatialIndex::hitTest(Shape& shape, const QPoint& point, int tolerance)
+{
+	PointSpan points = shape.pointSpan();
+	if (points.isEmpty()) {
+		return false;
+	}
+
+	const QPointF target(point);
+	const double toleranceSquared = static_cast<double>(tolerance) * tolerance;
+
+	switch (shape.getType()) {
+	case Shape::LINE:
+		return nearPolyline(toPointsF(points), false, target, toleranceSquared);
+	case Shape::RECTANGLE:
+	case Shape::POLYGON: {
+		QVector<QPointF> outline = toPointsF(points);
+		return (shape.getIsFilled() && outline.size() > 2 && insidePolygon(outline, target)) || nearPolyline(outline, true, target, toleranceSquared);
+	}
+	case Shape::CIRCLE: {
+		if (points.size() < 2) {
+			return false;
+		}
+		QRect bounds = shape.getBoundingRect();
+		double radius = (bounds.width() - 1) / 2.0;
+		double distance = std::hypot(target.x() - points[0].x(), target.y() - points[0].y());
+		return shape.getIsFilled() ? distance <= radius + tolerance : std::abs(distance - radius) <= tolerance;
+	}
+	case Shape::BEZIER_CURVE:
+		return nearPolyline(points.size() > 1 ? sampleBezier(points) : toPointsF(points), false, target, toleranceSquared);
+	default:
+		return shape.getBoundingRect().adjusted(-tolerance, -tolerance, tolerance, tolerance).contains(point);
+	}
+}
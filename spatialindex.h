@@ -0,0 +1,58 @@
+#pragma once
+#include <QPoint>
+#include <QRect>
+#include <unordered_map>
+#include <vector>
+#include "representation.h"
+
+// Uniform hash grid over shape bounding boxes, for view culling and picking in large scenes.
+// Every shape is linked into the cells its bounds (with the renderer's one pixel of slack) touch;
+// shapes spanning more than maxCellsPerShape cells are kept in a separate list that every query
+// scans, so one huge shape cannot flood the grid. The index knows nothing about stacking order:
+// results come back unordered and the owner ranks them (see LayerStack::positionOf).
+// Geometry changes must be reported through update() before the next query.
+class SpatialIndex {
+public:
+	explicit SpatialIndex(int cellShift = 6);
+
+	void insert(Shape* shape);
+	void update(Shape* shape);
+	void remove(const Shape* shape);
+	void clear();
+	int size() const { return static_cast<int>(entries.size()); }
+	bool contains(const Shape* shape) const { return indices.count(shape) != 0; }
+
+	// Shapes whose bounds intersect rect
+	void query(const QRect& rect, std::vector<Shape*>& result);
+
+	// Shapes drawn within tolerance pixels of point, i.e. the candidates for a click
+	void hitsAt(const QPoint& point, int tolerance, std::vector<Shape*>& result);
+
+	// Geometric pick test behind hitsAt: outlines within tolerance, filled interiors anywhere
+	static bool hitTest(Shape& shape, const QPoint& point, int tolerance);
+
+private:
+	static const int maxCellsPerShape = 256;
+
+	struct Entry {
+		Shape* shape;
+		QRect bounds;
+		bool oversized;
+		quint32 stamp;
+	};
+
+	int cellShift;
+	quint32 stamp = 0;
+	std::vector<Entry> entries;
+	std::unordered_map<const Shape*, int> indices;
+	std::unordered_map<qint64, std::vector<int>> cells;
+	std::vector<int> oversized;
+	std::vector<int> hits;
+
+	static qint64 cellKey(int column, int row) { return (static_cast<qint64>(column) << 32) | static_cast<quint32>(row); }
+	QRect cellRange(const QRect& bounds) const;
+	void link(int index);
+	void unlink(int index);
+	void renumber(int from, int to);
+	void collect(const QRect& rect);
+};
@@ -0,0 +1,220 @@
+// Regression tests for the scene containers and the rasterization kernels.
+//
+//	tests [--filter text]
+//
+// Every case prints its name and PASS or FAIL with the failed checks; the exit code is the number of
+// failed cases, so ctest reports any of them.
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QImage>
+#include <QString>
+#include <QVector>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <vector>
+#include "layercache.h"
+#include "layerstack.h"
+#include "rasterizer.h"
+#include "shapepool.h"
+#include "tilerenderer.h"
+
+namespace {
+
+class TestSuite {
+public:
+	explicit TestSuite(const QString& filter) : filter(filter) {}
+
+	int getFailedCount() const { return failedCount; }
+
+	void run(const QString& name, const std::function<void()>& body)
+	{
+		if (!filter.isEmpty() && !name.contains(filter)) {
+			return;
+		}
+
+		failures.clear();
+		body();
+		std::printf("%-56s %s\n", qPrintable(name), failures.isEmpty() ? "PASS" : "FAIL");
+		for (const QString& failure : failures) {
+			std::printf("\t%s\n", qPrintable(failure));
+		}
+		if (!failures.isEmpty()) {
+			failedCount++;
+		}
+	}
+
+	void check(bool condition, const QString& what)
+	{
+		if (!condition) {
+			failures.append(what);
+		}
+	}
+
+private:
+	QString filter;
+	QStringList failures;
+	int failedCount = 0;
+};
+
+//-----------------------------------------
+//		*** Layer stack ***
+//-----------------------------------------
+
+void testLayerStack(TestSuite& suite)
+{
+	// The viewer appends a list row for every new shape and removes the row of a deleted layer, so row N
+	// must stay the layer at position N: a new shape has to land on top even after lower layers went away
+	suite.run("layerstack/new shape on top after delete", [&suite]() {
+		ShapePool pool;
+		LayerStack layers;
+		QVector<Shape*> rows;
+		auto addShape = [&]() {
+			int depth = layers.nextDepth();
+			Shape* shape = pool.create<Line>(QPoint(0, 0), QPoint(10, 10), depth, false, Qt::black, Qt::black);
+			layers.insert(shape, depth);
+			rows.append(shape);
+		};
+
+		for (int i = 0; i < 4; i++) {
+			addShape();
+		}
+		layers.removeAt(0);
+		rows.remove(0);
+		layers.removeAt(1);
+		rows.remove(1);
+		addShape();
+		addShape();
+
+		suite.check(layers.size() == rows.size(), QString("%1 layers for %2 rows").arg(layers.size()).arg(rows.size()));
+		for (int row = 0; row < rows.size() && row < layers.size(); row++) {
+			suite.check(layers.at(row) == rows[row], QString("row %1 holds another layer than its position").arg(row));
+		}
+	});
+}
+
+//-----------------------------------------
+//		*** Rasterizer ***
+//-----------------------------------------
+
+void testRasterizer(TestSuite& suite)
+{
+	// (20,20) (220,20) (120,20) lies on one line but runs out to x = 153 and back to 120; every control point
+	// is near the infinite chord line, so only the distance to the chord segment keeps it from stopping at 120
+	suite.run("rasterizer/collinear curve overshooting its end", [&suite]() {
+		const QRect maskRect(0, 0, 300, 40);
+		std::vector<uchar> mask(static_cast<size_t>(maskRect.width()) * maskRect.height(), 0);
+		Rasterizer rasterizer(nullptr, maskRect.width(), maskRect.height(), 0);
+		rasterizer.setCoverageTarget(mask.data(), maskRect);
+
+		BezierCurve curve(QVector<QPoint>() << QPoint(20, 20) << QPoint(220, 20) << QPoint(120, 20), 0, false, Qt::black, Qt::black);
+		rasterizer.drawCurve(curve);
+
+		auto covered = [&](int x, int y) { return mask[static_cast<size_t>(y) * maskRect.width() + x] != 0; };
+		int farthest = -1;
+		for (int x = 0; x < maskRect.width(); x++) {
+			if (covered(x, 20)) {
+				farthest = x;
+			}
+		}
+		suite.check(farthest >= 152 && farthest <= 154, QString("curve ends at x = %1 instead of 153").arg(farthest));
+		suite.check(covered(20, 20) && covered(120, 20) && covered(150, 20), "gaps along the curve");
+	});
+}
+
+//-----------------------------------------
+//		*** Layer cache ***
+//-----------------------------------------
+
+bool samePixels(const QImage& a, const QImage& b)
+{
+	if (a.size() != b.size()) {
+		return false;
+	}
+	for (int y = 0; y < a.height(); y++) {
+		if (std::memcmp(a.constBits() + static_cast<size_t>(y) * a.bytesPerLine(), b.constBits() + static_cast<size_t>(y) * b.bytesPerLine(), static_cast<size_t>(a.width()) * 4) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Renders shapes once without a cache and twice through cache (building the masks, then replaying them)
+// and reports whether all three images agree
+bool replayMatches(const std::vector<Shape*>& shapes, LayerCache& cache)
+{
+	const QSize size(240, 120);
+	QImage fresh(size, QImage::Format_ARGB32_Premultiplied);
+	QImage building(size, QImage::Format_ARGB32_Premultiplied);
+	QImage replayed(size, QImage::Format_ARGB32_Premultiplied);
+
+	TileRenderer plain;
+	plain.render(fresh, shapes, fresh.rect(), qRgb(255, 255, 255));
+	TileRenderer cached;
+	cached.setLayerCache(&cache);
+	cached.render(building, shapes, building.rect(), qRgb(255, 255, 255));
+	cached.render(replayed, shapes, replayed.rect(), qRgb(255, 255, 255));
+	return samePixels(fresh, building) && samePixels(fresh, replayed);
+}
+
+void testLayerCache(TestSuite& suite)
+{
+	suite.run("layercache/masks only for requested shapes", [&suite]() {
+		ShapePool pool;
+		LayerCache cache;
+		Shape* under = pool.create<Circle>(QPoint(60, 60), QPoint(100, 60), 0, true, QColor(200, 30, 30), QColor(30, 200, 30));
+		Shape* over = pool.create<MyRectangle>(QPoint(40, 30), QPoint(160, 30), QPoint(160, 90), QPoint(40, 90), 1, true, QColor(20, 20, 200), QColor(240, 200, 20));
+		over->setOpacity(0.5);
+		over->setBlendMode(Shape::MULTIPLY);
+		std::vector<Shape*> shapes = { under, over };
+
+		suite.check(replayMatches(shapes, cache), "rendering without masks differs");
+		suite.check(!cache.find(under) && !cache.find(over) && cache.getUsedBytes() == 0, "masks built without a request");
+
+		cache.request(over);
+		suite.check(replayMatches(shapes, cache), "replay of a translucent multiply layer differs");
+		suite.check(!cache.find(under) && cache.find(over), "mask of the requested shape only expected");
+
+		cache.invalidate(over);
+		suite.check(replayMatches(shapes, cache) && !cache.find(over), "invalidating did not drop the request");
+	});
+
+	// A closed outline running back and forth over one row hits its pixels far more than 15 times
+	suite.run("layercache/saturated counts fall back to rasterization", [&suite]() {
+		ShapePool pool;
+		LayerCache cache;
+		QVector<QPoint> zigzag;
+		for (int i = 0; i < 12; i++) {
+			zigzag << QPoint(20, 60) << QPoint(220, 60);
+		}
+		Shape* shape = pool.create<MyPolygon>(zigzag, 0, false, QColor(20, 20, 200), QColor(20, 20, 200));
+		shape->setOpacity(0.25);
+		std::vector<Shape*> shapes = { shape };
+
+		cache.request(shape);
+		suite.check(replayMatches(shapes, cache), "translucent overlapping outline differs from rasterization");
+		suite.check(!cache.find(shape) && cache.getUsedBytes() == 0, "saturated mask still in use");
+	});
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+	QCoreApplication app(argc, argv);
+	QCoreApplication::setApplicationName("ImageViewer tests");
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Regression tests for the ImageViewer scene containers and rasterization kernels.");
+	parser.addHelpOption();
+	QCommandLineOption filterOption("filter", "Only run cases whose name contains text.", "text");
+	parser.addOption(filterOption);
+	parser.process(app);
+
+	TestSuite suite(parser.value(filterOption));
+	testLayerStack(suite);
+	testRasterizer(suite);
+	testLayerCache(suite);
+
+	return suite.getFailedCount();
+}
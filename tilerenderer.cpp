@@ -0,0 +1,173 @@
+#include "tilerenderer.h"
+#include "compositing.h"
+#include "instrumentation.h"
+#include <QRunnable>
+#include <QtAlgorithms>
+#include <algorithm>
+
+//-----------------------------------------
+//		*** Tile jobs ***
+//-----------------------------------------
+
+namespace {
+
+class TileJob : public QRunnable {
+public:
+	TileJob(uchar* data, int width, int height, int bytesPerLine, const QRect& tile, QRgb background, const QImage* under, const QImage* over, const std::atomic<bool>* cancelled)
+		: rasterizer(data, width, height, bytesPerLine), data(data), bytesPerLine(bytesPerLine), tile(tile), background(background), under(under), over(over), cancelled(cancelled)
+	{
+		setAutoDelete(false);
+		rasterizer.setClipRect(tile);
+	}
+
+	void addShape(Shape* shape, const LayerCache::Entry* cached) { shapes.push_back({ shape, cached }); }
+
+	void run() override
+	{
+		INSTRUMENT_SCOPE("TileRenderer::tile");
+		if (isCancelled()) {
+			return;
+		}
+		for (int y = tile.top(); y <= tile.bottom(); y++) {
+			QRgb* row = reinterpret_cast<QRgb*>(data + static_cast<size_t>(y) * bytesPerLine);
+			if (under) {
+				const QRgb* source = reinterpret_cast<const QRgb*>(under->constScanLine(y));
+				std::copy(source + tile.left(), source + tile.right() + 1, row + tile.left());
+			}
+			else {
+				std::fill(row + tile.left(), row + tile.right() + 1, background);
+			}
+		}
+
+		// Shapes were binned in z order, so painter's order holds within the tile
+		for (size_t i = 0; i < shapes.size(); i++) {
+			if (i % cancelCheckInterval == 0 && isCancelled()) {
+				return;
+			}
+			const auto& item = shapes[i];
+			if (item.second) {
+				LayerCache::composite(*item.second, *item.first, data, bytesPerLine, tile);
+			}
+			else {
+				rasterizer.drawShape(*item.first);
+			}
+		}
+
+		if (over) {
+			for (int y = tile.top(); y <= tile.bottom(); y++) {
+				QRgb* row = reinterpret_cast<QRgb*>(data + static_cast<size_t>(y) * bytesPerLine);
+				const QRgb* source = reinterpret_cast<const QRgb*>(over->constScanLine(y));
+				compositeSpan(row + tile.left(), source + tile.left(), tile.width());
+			}
+		}
+	}
+
+private:
+	static const size_t cancelCheckInterval = 256;
+
+	Rasterizer rasterizer;
+	uchar* data;
+	int bytesPerLine;
+	QRect tile;
+	QRgb background;
+	const QImage* under;
+	const QImage* over;
+	const std::atomic<bool>* cancelled;
+	std::vector<std::pair<Shape*, const LayerCache::Entry*>> shapes;
+
+	bool isCancelled() const { return cancelled && cancelled->load(std::memory_order_relaxed); }
+};
+
+}
+
+//-----------------------------------------
+//		*** Tile renderer ***
+//-----------------------------------------
+
+TileRenderer::TileRenderer(int tileSize)
+{
+	setTileSize(tileSize);
+}
+
+TileRenderer::~TileRenderer()
+{
+	pool.waitForDone();
+}
+
+void TileRenderer::render(QImage& target, const std::vector<Shape*>& shapes, const QRect& region, QRgb background)
+{
+	INSTRUMENT_SCOPE("TileRenderer::render");
+	QRect area = region.intersected(target.rect());
+	if (area.isEmpty()) {
+		return;
+	}
+
+	if (layerCache) {
+		layerCache->prepare(shapes, area, target.width(), target.height(), pool);
+	}
+	renderTiles(target, shapes, area, background, nullptr, nullptr);
+}
+
+void TileRenderer::renderBetween(QImage& target, const std::vector<Shape*>& shapes, const QRect& region, const QImage& under, const QImage& over)
+{
+	INSTRUMENT_SCOPE("TileRenderer::renderBetween");
+	QRect area = region.intersected(target.rect()).intersected(under.rect()).intersected(over.rect());
+	if (area.isEmpty()) {
+		return;
+	}
+	renderTiles(target, shapes, area, 0, &under, &over);
+}
+
+void TileRenderer::renderTiles(QImage& target, const std::vector<Shape*>& shapes, const QRect& area, QRgb background, const QImage* under, const QImage* over)
+{
+	// bits() may detach the image, so it is resolved once here rather than from the workers
+	uchar* data = target.bits();
+	const int width = target.width();
+	const int height = target.height();
+	const int bytesPerLine = target.bytesPerLine();
+
+	const int columns = (area.width() + tileSize - 1) / tileSize;
+	const int rows = (area.height() + tileSize - 1) / tileSize;
+
+	std::vector<TileJob*> jobs;
+	jobs.reserve(static_cast<size_t>(columns) * rows);
+	for (int row = 0; row < rows; row++) {
+		for (int column = 0; column < columns; column++) {
+			QRect tile(area.left() + column * tileSize, area.top() + row * tileSize, tileSize, tileSize);
+			jobs.push_back(new TileJob(data, width, height, bytesPerLine, tile.intersected(area), background, under, over, cancelFlag));
+		}
+	}
+
+	for (Shape* shape : shapes) {
+		// One pixel of slack covers rounding in the scan converters
+		QRect bounds = shape->getBoundingRect().adjusted(-1, -1, 1, 1).intersected(area);
+		if (bounds.isEmpty()) {
+			continue;
+		}
+		const LayerCache::Entry* cached = layerCache ? layerCache->find(shape) : nullptr;
+
+		int firstColumn = (bounds.left() - area.left()) / tileSize;
+		int lastColumn = (bounds.right() - area.left()) / tileSize;
+		int firstRow = (bounds.top() - area.top()) / tileSize;
+		int lastRow = (bounds.bottom() - area.top()) / tileSize;
+		for (int row = firstRow; row <= lastRow; row++) {
+			for (int column = firstColumn; column <= lastColumn; column++) {
+				jobs[row * columns + column]->addShape(shape, cached);
+			}
+		}
+	}
+
+	if (jobs.size() == 1 || pool.maxThreadCount() <= 1) {
+		for (TileJob* job : jobs) {
+			job->run();
+		}
+	}
+	else {
+		for (TileJob* job : jobs) {
+			pool.start(job);
+		}
+		pool.waitForDone();
+	}
+
+	qDeleteAll(jobs);
+}
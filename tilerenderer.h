@@ -0,0 +1,46 @@
+#pragma once
+#include <QImage>
+#include <QRect>
+#include <QThreadPool>
+#include <atomic>
+#include <vector>
+#include "rasterizer.h"
+#include "layercache.h"
+
+// Redraws a region of a premultiplied ARGB32 image from a list of shapes in painter's order.
+// The region is cut into square tiles and every shape is binned to the tiles its bounding box
+// touches. Each tile is then cleared and rasterized on the thread pool through its own Rasterizer
+// clipped to the tile, so tiles never share pixels and the result matches a sequential redraw.
+class TileRenderer {
+private:
+	int tileSize;
+	QThreadPool pool;
+	LayerCache* layerCache = nullptr;
+	const std::atomic<bool>* cancelFlag = nullptr;
+
+public:
+	explicit TileRenderer(int tileSize = 128);
+	~TileRenderer();
+
+	void setTileSize(int size) { tileSize = size < 16 ? 16 : size; }
+	int getTileSize() const { return tileSize; }
+	void setMaxThreadCount(int count) { pool.setMaxThreadCount(count); }
+	int getMaxThreadCount() const { return pool.maxThreadCount(); }
+
+	// Shapes with a cached mask are composited from it instead of being rasterized again
+	void setLayerCache(LayerCache* cache) { layerCache = cache; }
+
+	// Tiles stop early once *flag turns true, leaving the region partly drawn; nullptr renders to the end
+	void setCancelFlag(const std::atomic<bool>* flag) { cancelFlag = flag; }
+
+	// Clears region to background and draws shapes (bottom to top) into target, blocking until done
+	void render(QImage& target, const std::vector<Shape*>& shapes, const QRect& region, QRgb background);
+
+	// Redraws region as under, then shapes, then over composited source-over on top. under and over
+	// are premultiplied images of target's size, for redrawing a few layers between two fixed composites.
+	// Shapes are not given new cache masks, since the ones drawn this way are usually changing.
+	void renderBetween(QImage& target, const std::vector<Shape*>& shapes, const QRect& region, const QImage& under, const QImage& over);
+
+private:
+	void renderTiles(QImage& target, const std::vector<Shape*>& shapes, const QRect& area, QRgb background, const QImage* under, const QImage* over);
+};